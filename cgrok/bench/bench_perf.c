@@ -0,0 +1,168 @@
+#include "bench_perf.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+static const char *const names[BENCH_PERF_NCOUNTERS] = {
+  "cycles", "instructions", "branch-misses", "L1d-misses", "LLC-misses"
+};
+
+const char *bench_perf_name(int counter) {
+  return names[counter];
+}
+
+int bench_perf_available(const bench_perf_t *perf, int counter) {
+  return perf->fds[counter] >= 0;
+}
+
+#ifdef __linux__
+static void counter_attr(int counter, struct perf_event_attr *attr) {
+  memset(attr, 0, sizeof(*attr));
+  attr->size = sizeof(*attr);
+  attr->type = PERF_TYPE_HARDWARE;
+  switch (counter) {
+    case BENCH_PERF_CYCLES:
+      attr->config = PERF_COUNT_HW_CPU_CYCLES;
+      break;
+    case BENCH_PERF_INSTRUCTIONS:
+      attr->config = PERF_COUNT_HW_INSTRUCTIONS;
+      break;
+    case BENCH_PERF_BRANCH_MISSES:
+      attr->config = PERF_COUNT_HW_BRANCH_MISSES;
+      break;
+    case BENCH_PERF_L1D_MISSES:
+      attr->type = PERF_TYPE_HW_CACHE;
+      attr->config = PERF_COUNT_HW_CACHE_L1D
+                     | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                     | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+      break;
+    case BENCH_PERF_LLC_MISSES:
+      attr->config = PERF_COUNT_HW_CACHE_MISSES;
+      break;
+  }
+  attr->read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED
+                      | PERF_FORMAT_TOTAL_TIME_RUNNING;
+  attr->exclude_kernel = 1;
+  attr->exclude_hv = 1;
+  attr->disabled = 1;
+}
+
+int bench_perf_open(bench_perf_t *perf, const char **error) {
+  int counter, first_errno = 0;
+
+  perf->leader = -1;
+  perf->nopen = 0;
+  for (counter = 0; counter < BENCH_PERF_NCOUNTERS; counter++) {
+    struct perf_event_attr attr;
+    int fd;
+
+    counter_attr(counter, &attr);
+    fd = syscall(SYS_perf_event_open, &attr, 0, -1, perf->leader, 0);
+    perf->fds[counter] = fd;
+    if (fd < 0) {
+      if (first_errno == 0) {
+        first_errno = errno;
+      }
+      continue;
+    }
+    if (perf->leader < 0) {
+      perf->leader = fd;
+    }
+    perf->slots[counter] = perf->nopen++;
+  }
+
+  if (perf->nopen == 0) {
+    switch (first_errno) {
+      case ENOENT:
+      case EOPNOTSUPP:
+        *error = "no hardware counters on this CPU (a virtual machine?)";
+        break;
+      case EACCES:
+      case EPERM:
+        *error = "not permitted; see /proc/sys/kernel/perf_event_paranoid";
+        break;
+      case ENOSYS:
+        *error = "perf events aren't supported by this kernel";
+        break;
+      default:
+        *error = strerror(first_errno);
+    }
+    return 0;
+  }
+  ioctl(perf->leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+  ioctl(perf->leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+  return perf->nopen;
+}
+
+void bench_perf_close(bench_perf_t *perf) {
+  int counter;
+  for (counter = 0; counter < BENCH_PERF_NCOUNTERS; counter++) {
+    if (perf->fds[counter] >= 0) {
+      close(perf->fds[counter]);
+    }
+  }
+  perf->nopen = 0;
+}
+
+void bench_perf_read(const bench_perf_t *perf, bench_perf_sample_t *sample) {
+  /* the number of counters, time enabled, time running, then each value */
+  uint64_t buf[3 + BENCH_PERF_NCOUNTERS];
+  int counter;
+
+  memset(sample, 0, sizeof(*sample));
+  if (perf->nopen == 0
+      || read(perf->leader, buf, sizeof(buf)) < 3 * (ssize_t)sizeof(uint64_t)) {
+    return;
+  }
+  sample->enabled = buf[1];
+  sample->running = buf[2];
+  for (counter = 0; counter < BENCH_PERF_NCOUNTERS; counter++) {
+    if (perf->fds[counter] >= 0 && perf->slots[counter] < (int)buf[0]) {
+      sample->values[counter] = buf[3 + perf->slots[counter]];
+    }
+  }
+}
+#else
+int bench_perf_open(bench_perf_t *perf, const char **error) {
+  int counter;
+  for (counter = 0; counter < BENCH_PERF_NCOUNTERS; counter++) {
+    perf->fds[counter] = -1;
+  }
+  perf->leader = -1;
+  perf->nopen = 0;
+  *error = "perf events are only supported on Linux";
+  return 0;
+}
+
+void bench_perf_close(bench_perf_t *perf) {
+}
+
+void bench_perf_read(const bench_perf_t *perf, bench_perf_sample_t *sample) {
+  memset(sample, 0, sizeof(*sample));
+}
+#endif
+
+void bench_perf_accumulate(bench_perf_sample_t *total,
+                           const bench_perf_sample_t *start,
+                           const bench_perf_sample_t *end) {
+  int counter;
+  for (counter = 0; counter < BENCH_PERF_NCOUNTERS; counter++) {
+    total->values[counter] += end->values[counter] - start->values[counter];
+  }
+  total->enabled += end->enabled - start->enabled;
+  total->running += end->running - start->running;
+}
+
+double bench_perf_scaled(const bench_perf_sample_t *total, int counter) {
+  if (total->running == 0) {
+    return 0;
+  }
+  return (double)total->values[counter] * total->enabled / total->running;
+}
@@ -0,0 +1,68 @@
+/*
+ * Hardware performance counters for grok_bench, through perf_event_open(2).
+ *
+ * The counters are opened as one group and read together, so a phase's
+ * counts are the difference between two bench_perf_read() snapshots. Any
+ * counter the kernel or CPU won't provide is left out; on systems without
+ * perf events at all, bench_perf_open() reports why and opens nothing.
+ */
+#ifndef _BENCH_PERF_H_
+#define _BENCH_PERF_H_
+
+#include <stdint.h>
+
+enum {
+  BENCH_PERF_CYCLES,
+  BENCH_PERF_INSTRUCTIONS,
+  BENCH_PERF_BRANCH_MISSES,
+  BENCH_PERF_L1D_MISSES,
+  BENCH_PERF_LLC_MISSES,
+  BENCH_PERF_NCOUNTERS
+};
+
+typedef struct bench_perf {
+  /** file descriptor of each counter, or -1 if it couldn't be opened */
+  int fds[BENCH_PERF_NCOUNTERS];
+  int leader;
+  int nopen;
+
+  /** position of each open counter in the group's read format */
+  int slots[BENCH_PERF_NCOUNTERS];
+} bench_perf_t;
+
+/** Counter values at one point, indexed by BENCH_PERF_*, and the time the
+ * group was enabled and actually counting. running < enabled means the
+ * kernel multiplexed the group with other events. */
+typedef struct bench_perf_sample {
+  uint64_t values[BENCH_PERF_NCOUNTERS];
+  uint64_t enabled;
+  uint64_t running;
+} bench_perf_sample_t;
+
+/**
+ * Open and enable the counters for this thread, user space only.
+ *
+ * @param error set to a description of why nothing could be opened.
+ * @returns the number of counters opened.
+ */
+int bench_perf_open(bench_perf_t *perf, const char **error);
+void bench_perf_close(bench_perf_t *perf);
+
+/** @returns 1 if counter was opened */
+int bench_perf_available(const bench_perf_t *perf, int counter);
+
+/** @returns the name of a BENCH_PERF_* counter */
+const char *bench_perf_name(int counter);
+
+/** Snapshot every open counter with one read() */
+void bench_perf_read(const bench_perf_t *perf, bench_perf_sample_t *sample);
+
+/** Add end - start to total */
+void bench_perf_accumulate(bench_perf_sample_t *total,
+                           const bench_perf_sample_t *start,
+                           const bench_perf_sample_t *end);
+
+/** @returns a counter's total, scaled up for any time it wasn't running */
+double bench_perf_scaled(const bench_perf_sample_t *total, int counter);
+
+#endif /* _BENCH_PERF_H_ */
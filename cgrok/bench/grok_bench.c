@@ -0,0 +1,450 @@
+/*
+ * grok_bench: replay a corpus through a list of grok patterns and report
+ * where the time goes, without the Go runtime in the picture.
+ *
+ * Each line is tried against the patterns in order until one matches, as a
+ * grok program would, and the matching pattern's captures are walked. The
+ * report covers throughput, time per phase, per-line latency percentiles
+ * and peak RSS.
+ *
+ * With -H, each phase also gets hardware counters from perf_event_open(2):
+ * cycles, instructions, IPC, branch misses and L1d/LLC misses per line or
+ * per match. Counters the CPU, kernel or container won't give us are left
+ * out of the report; if none are available, it says why and carries on.
+ * Reading the counters costs a system call per phase, so timings under -H
+ * run a little slower than without it.
+ *
+ * Phases:
+ *   expand   grok_compilen() less the PCRE compile and study, per compile
+ *   compile  pcre_compile() and pcre_study() of the expanded regexp
+ *   exec     grok_execn() over the pattern list, per line
+ *   walk     grok_match_walk_*() over the captures of a matched line
+ *   lookup   grok_match_get_named_substring() of each capture by name, which
+ *            goes through the capture trees the walk doesn't
+ *
+ * Build with make in this directory; see grok_corpus for test input.
+ */
+#include "grok.h"
+#include "bench_perf.h"
+
+#include <getopt.h>
+#include <sys/resource.h>
+#include <time.h>
+
+typedef struct bench_pattern {
+  char *expr;
+  grok_t grok;
+  uint64_t matches;
+  uint64_t expand_ns;
+  uint64_t compile_ns;
+
+  /** capture names, for the lookup phase */
+  char **names;
+  int nnames;
+} bench_pattern_t;
+
+typedef struct bench_corpus {
+  char *data;
+  long size;
+  long *offsets;  /* line i is data[offsets[i] .. offsets[i + 1] - 1) */
+  long nlines;
+} bench_corpus_t;
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void usage(const char *prog) {
+  fprintf(stderr,
+          "usage: %s [options] corpus\n"
+          "  -p FILE  load pattern definitions (repeatable; default %s)\n"
+          "  -e EXPR  match this grok expression (repeatable)\n"
+          "  -P FILE  match the expressions in FILE, one per line\n"
+          "  -r N     passes over the corpus (default 1)\n"
+          "  -c N     compiles of each expression to time (default 20)\n"
+          "  -R       only keep renamed captures, like %%{INT:name}\n"
+          "  -H       count cycles, instructions and cache misses per phase\n",
+          prog, GROK_BENCH_PATTERNS);
+  exit(2);
+}
+
+/* Read a whole file, or stdin for "-". Exits on failure. */
+static char *read_file(const char *path, long *size) {
+  FILE *fp = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+  char *data = NULL;
+  long len = 0, alloc = 0;
+  size_t n;
+
+  if (fp == NULL) {
+    perror(path);
+    exit(1);
+  }
+  do {
+    if (alloc - len < 65536) {
+      alloc = alloc ? alloc * 2 : 1 << 20;
+      data = realloc(data, alloc + 1);
+    }
+    n = fread(data + len, 1, alloc - len, fp);
+    len += n;
+  } while (n > 0);
+  if (fp != stdin) {
+    fclose(fp);
+  }
+  data[len] = '\0';
+  *size = len;
+  return data;
+}
+
+static void corpus_load(bench_corpus_t *corpus, const char *path) {
+  long pos = 0, size = 1024;
+
+  corpus->data = read_file(path, &corpus->size);
+  corpus->offsets = malloc(size * sizeof(long));
+  corpus->nlines = 0;
+  while (pos < corpus->size) {
+    char *newline = memchr(corpus->data + pos, '\n', corpus->size - pos);
+    if (corpus->nlines + 2 > size) {
+      size *= 2;
+      corpus->offsets = realloc(corpus->offsets, size * sizeof(long));
+    }
+    corpus->offsets[corpus->nlines++] = pos;
+    pos = newline ? newline - corpus->data + 1 : corpus->size + 1;
+  }
+  corpus->offsets[corpus->nlines] = pos;
+}
+
+static void add_expr(bench_pattern_t **patterns, int *npatterns,
+                     const char *expr, int len) {
+  bench_pattern_t *pattern;
+  *patterns = realloc(*patterns, (*npatterns + 1) * sizeof(bench_pattern_t));
+  pattern = *patterns + (*npatterns)++;
+  memset(pattern, 0, sizeof(*pattern));
+  pattern->expr = strndup(expr, len);
+}
+
+/* Add each non-empty, non-comment line of path as an expression */
+static void add_expr_file(bench_pattern_t **patterns, int *npatterns,
+                          const char *path) {
+  long size;
+  char *data = read_file(path, &size);
+  char *line = data;
+  while (line < data + size) {
+    char *end = memchr(line, '\n', data + size - line);
+    if (end == NULL) {
+      end = data + size;
+    }
+    if (end > line && line[0] != '#') {
+      add_expr(patterns, npatterns, line, end - line);
+    }
+    line = end + 1;
+  }
+  free(data);
+}
+
+/* Compile pattern against base's definitions, compiles times over, and
+ * split the time between expansion and PCRE. Exits on failure. */
+static void compile_pattern(bench_pattern_t *pattern, const grok_t *base,
+                            int compiles, int only_renamed) {
+  int i;
+  for (i = 0; i < compiles; i++) {
+    const char *errptr;
+    int erroffset;
+    uint64_t start, compiled, recompiled;
+    pcre *re;
+    pcre_extra *extra;
+
+    if (i > 0) {
+      grok_free_clone(&pattern->grok);
+    }
+    grok_clone(&pattern->grok, base);
+
+    start = now_ns();
+    if (grok_compile(&pattern->grok, pattern->expr, only_renamed) != GROK_OK) {
+      fprintf(stderr, "failed to compile %s: %s\n", pattern->expr,
+              pattern->grok.errstr);
+      exit(1);
+    }
+    compiled = now_ns();
+
+    /* grok_compilen() doesn't time its own steps, so redo the PCRE part
+     * of it to find out how much of the total that was */
+    re = pcre_compile(pattern->grok.full_pattern, 0, &errptr, &erroffset,
+                      NULL);
+    extra = pcre_study(re, 0, &errptr);
+    recompiled = now_ns();
+    if (extra != NULL) {
+      pcre_free(extra);
+    }
+    pcre_free(re);
+
+    if (recompiled - compiled < compiled - start) {
+      pattern->expand_ns += (compiled - start) - (recompiled - compiled);
+    }
+    pattern->compile_ns += recompiled - compiled;
+  }
+}
+
+/* Collect the names of pattern's captures */
+static void collect_names(bench_pattern_t *pattern) {
+  TCTREE_ITER *iter = grok_capture_walk_init(&pattern->grok);
+  const grok_capture *gct;
+  while ((gct = grok_capture_walk_next(iter, &pattern->grok)) != NULL) {
+    pattern->names = realloc(pattern->names,
+                             (pattern->nnames + 1) * sizeof(char *));
+    pattern->names[pattern->nnames++] = strndup(gct->name, gct->name_len);
+  }
+  tctreeiterfree(iter);
+}
+
+static int compare_u32(const void *a, const void *b) {
+  uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+  return x < y ? -1 : x > y;
+}
+
+static void print_phase(const char *name, uint64_t ns, uint64_t count,
+                        const char *per) {
+  printf("  %-8s %12.3f ms %12.1f ns/%s\n", name, ns / 1e6,
+         count ? (double)ns / count : 0.0, per);
+}
+
+static void print_counters(const bench_perf_t *perf, const char *name,
+                           const bench_perf_sample_t *total, uint64_t count) {
+  int counter;
+  printf("  %-8s", name);
+  for (counter = 0; counter < BENCH_PERF_NCOUNTERS; counter++) {
+    if (!bench_perf_available(perf, counter) || count == 0) {
+      printf(" %13s", "-");
+    } else {
+      printf(" %13.1f", bench_perf_scaled(total, counter) / count);
+    }
+  }
+  if (bench_perf_available(perf, BENCH_PERF_CYCLES)
+      && bench_perf_available(perf, BENCH_PERF_INSTRUCTIONS)
+      && total->values[BENCH_PERF_CYCLES] > 0) {
+    printf(" %6.2f", (double)total->values[BENCH_PERF_INSTRUCTIONS]
+                     / total->values[BENCH_PERF_CYCLES]);
+  } else {
+    printf(" %6s", "-");
+  }
+  printf("\n");
+}
+
+int main(int argc, char **argv) {
+  grok_t *base = grok_new();
+  bench_pattern_t *patterns = NULL;
+  bench_corpus_t corpus;
+  int npatterns = 0;
+  int passes = 1, compiles = 20, only_renamed = 0;
+  int loaded_definitions = 0, use_counters = 0, counters = 0;
+  uint64_t exec_ns = 0, walk_ns = 0, lookup_ns = 0;
+  uint64_t expand_ns = 0, compile_ns = 0;
+  uint64_t matched = 0, captures = 0, wall;
+  uint32_t *latencies;
+  long nsamples, line;
+  struct rusage usage_info;
+  bench_perf_t perf;
+  bench_perf_sample_t exec_counts, walk_counts, lookup_counts;
+  const char *perf_error = NULL;
+  int opt, i, pass;
+
+  while ((opt = getopt(argc, argv, "p:e:P:r:c:RHh")) != -1) {
+    switch (opt) {
+      case 'p':
+        if (grok_patterns_import_from_file(base, optarg) != GROK_OK) {
+          fprintf(stderr, "failed to load pattern definitions from %s\n",
+                  optarg);
+          return 1;
+        }
+        loaded_definitions = 1;
+        break;
+      case 'e':
+        add_expr(&patterns, &npatterns, optarg, strlen(optarg));
+        break;
+      case 'P':
+        add_expr_file(&patterns, &npatterns, optarg);
+        break;
+      case 'r':
+        passes = atoi(optarg);
+        break;
+      case 'c':
+        compiles = atoi(optarg);
+        break;
+      case 'R':
+        only_renamed = 1;
+        break;
+      case 'H':
+        use_counters = 1;
+        break;
+      default:
+        usage(argv[0]);
+    }
+  }
+  if (optind != argc - 1 || npatterns == 0 || passes < 1 || compiles < 1) {
+    usage(argv[0]);
+  }
+  if (!loaded_definitions
+      && grok_patterns_import_from_file(base, GROK_BENCH_PATTERNS) != GROK_OK) {
+    fprintf(stderr, "failed to load pattern definitions from %s\n",
+            GROK_BENCH_PATTERNS);
+    return 1;
+  }
+
+  for (i = 0; i < npatterns; i++) {
+    compile_pattern(&patterns[i], base, compiles, only_renamed);
+    expand_ns += patterns[i].expand_ns;
+    compile_ns += patterns[i].compile_ns;
+    collect_names(&patterns[i]);
+  }
+
+  corpus_load(&corpus, argv[optind]);
+  nsamples = corpus.nlines * passes;
+  latencies = malloc((nsamples ? nsamples : 1) * sizeof(uint32_t));
+
+  memset(&exec_counts, 0, sizeof(exec_counts));
+  memset(&walk_counts, 0, sizeof(walk_counts));
+  memset(&lookup_counts, 0, sizeof(lookup_counts));
+  if (use_counters) {
+    counters = bench_perf_open(&perf, &perf_error);
+  }
+
+  wall = now_ns();
+  for (pass = 0; pass < passes; pass++) {
+    for (line = 0; line < corpus.nlines; line++) {
+      const char *text = corpus.data + corpus.offsets[line];
+      int len = corpus.offsets[line + 1] - corpus.offsets[line] - 1;
+      grok_match_t gm;
+      bench_pattern_t *pattern = NULL;
+      bench_perf_sample_t before, after_exec, after_walk, after_lookup;
+      uint64_t start, executed, walked, looked_up;
+
+      if (counters) {
+        bench_perf_read(&perf, &before);
+      }
+      start = now_ns();
+      for (i = 0; i < npatterns; i++) {
+        if (grok_execn(&patterns[i].grok, text, len, &gm) == GROK_OK) {
+          pattern = &patterns[i];
+          break;
+        }
+      }
+      executed = now_ns();
+      if (counters) {
+        bench_perf_read(&perf, &after_exec);
+        bench_perf_accumulate(&exec_counts, &before, &after_exec);
+      }
+
+      if (pattern == NULL) {
+        walked = looked_up = now_ns();
+      } else {
+        char *name;
+        const char *substr;
+        int namelen, substrlen;
+
+        grok_match_walk_init(&gm);
+        while (grok_match_walk_next(&gm, &name, &namelen, &substr,
+                                    &substrlen) == 0) {
+          captures++;
+        }
+        grok_match_walk_end(&gm);
+        walked = now_ns();
+        if (counters) {
+          bench_perf_read(&perf, &after_walk);
+          bench_perf_accumulate(&walk_counts, &after_exec, &after_walk);
+        }
+
+        for (i = 0; i < pattern->nnames; i++) {
+          grok_match_get_named_substring(&gm, pattern->names[i], &substr,
+                                         &substrlen);
+        }
+        looked_up = now_ns();
+        if (counters) {
+          bench_perf_read(&perf, &after_lookup);
+          bench_perf_accumulate(&lookup_counts, &after_walk, &after_lookup);
+        }
+
+        grok_match_free(&gm);
+        pattern->matches++;
+        matched++;
+      }
+
+      exec_ns += executed - start;
+      walk_ns += walked - executed;
+      lookup_ns += looked_up - walked;
+      latencies[pass * corpus.nlines + line] =
+        looked_up - start > UINT32_MAX ? UINT32_MAX : looked_up - start;
+    }
+  }
+  wall = now_ns() - wall;
+
+  qsort(latencies, nsamples, sizeof(uint32_t), compare_u32);
+  getrusage(RUSAGE_SELF, &usage_info);
+
+  printf("grok %s\n", GROK_VERSION);
+  printf("corpus: %ld lines, %.2f MB, %d passes\n", corpus.nlines,
+         corpus.size / 1e6, passes);
+  printf("matched: %llu of %ld lines (%.1f%%), %.1f captures per match\n",
+         (unsigned long long)matched, nsamples,
+         nsamples ? 100.0 * matched / nsamples : 0.0,
+         matched ? (double)captures / matched : 0.0);
+  for (i = 0; i < npatterns; i++) {
+    printf("  [%d] %10llu  %s\n", i, (unsigned long long)patterns[i].matches,
+           patterns[i].expr);
+  }
+
+  printf("phases:\n");
+  print_phase("expand", expand_ns, (uint64_t)npatterns * compiles, "compile");
+  print_phase("compile", compile_ns, (uint64_t)npatterns * compiles,
+              "compile");
+  print_phase("exec", exec_ns, nsamples, "line");
+  print_phase("walk", walk_ns, matched, "match");
+  print_phase("lookup", lookup_ns, matched, "match");
+
+  if (use_counters && !counters) {
+    printf("hardware counters unavailable: %s\n", perf_error);
+  } else if (counters) {
+    printf("counters per line (exec) or match (walk, lookup):\n");
+    printf("  %-8s", "");
+    for (i = 0; i < BENCH_PERF_NCOUNTERS; i++) {
+      printf(" %13s", bench_perf_name(i));
+    }
+    printf(" %6s\n", "IPC");
+    print_counters(&perf, "exec", &exec_counts, nsamples);
+    print_counters(&perf, "walk", &walk_counts, matched);
+    print_counters(&perf, "lookup", &lookup_counts, matched);
+    if (exec_counts.running < exec_counts.enabled) {
+      printf("  counters were multiplexed, running %.0f%% of the time; "
+             "counts are scaled up to match\n",
+             100.0 * exec_counts.running / exec_counts.enabled);
+    }
+    bench_perf_close(&perf);
+  }
+
+  printf("throughput: %.0f lines/s, %.2f MB/s\n",
+         wall ? nsamples / (wall / 1e9) : 0.0,
+         wall ? corpus.size * (double)passes / 1e6 / (wall / 1e9) : 0.0);
+  if (nsamples > 0) {
+    printf("latency ns: p50 %u  p90 %u  p99 %u  p99.9 %u  max %u\n",
+           latencies[nsamples / 2], latencies[nsamples * 9 / 10],
+           latencies[nsamples * 99 / 100], latencies[nsamples * 999 / 1000],
+           latencies[nsamples - 1]);
+  }
+  printf("peak RSS: %ld KB\n", usage_info.ru_maxrss);
+
+  for (i = 0; i < npatterns; i++) {
+    int j;
+    for (j = 0; j < patterns[i].nnames; j++) {
+      free(patterns[i].names[j]);
+    }
+    free(patterns[i].names);
+    grok_free_clone(&patterns[i].grok);
+    free(patterns[i].expr);
+  }
+  free(patterns);
+  free(latencies);
+  free(corpus.offsets);
+  free(corpus.data);
+  grok_free(base);
+  return 0;
+}
@@ -0,0 +1,190 @@
+/*
+ * grok_corpus: write a deterministic synthetic log corpus for grok_bench.
+ *
+ * Lines come in three kinds, mixed in controllable proportions:
+ *   matching      syslog, Apache combined or key=value lines, which the
+ *                 expressions in synthetic.patterns match
+ *   noise         short lines none of them match
+ *   pathological  long near misses that make those expressions backtrack:
+ *                 runs of syslog headers with no program, Apache lines with
+ *                 an unterminated quote, and key=value lines that never
+ *                 reach their last key
+ *
+ * The same seed and options always give the same output.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static uint64_t rng_state;
+
+/* xorshift64* */
+static uint64_t rng_next(void) {
+  rng_state ^= rng_state >> 12;
+  rng_state ^= rng_state << 25;
+  rng_state ^= rng_state >> 27;
+  return rng_state * 2685821657736338717ULL;
+}
+
+static int rng_below(int n) {
+  return (int)((rng_next() >> 33) % n);
+}
+
+static const char *pick(const char *const *list, int n) {
+  return list[rng_below(n)];
+}
+
+#define PICK(list) pick(list, sizeof(list) / sizeof(list[0]))
+
+static const char *const months[] = {
+  "Jan", "Feb", "Mar", "Apr", "May", "Jun",
+  "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"
+};
+static const char *const hosts[] = { "web01", "web02", "db-master", "lb1" };
+static const char *const programs[] = {
+  "sshd", "CRON", "systemd", "postfix/smtpd", "sudo"
+};
+static const char *const verbs[] = { "GET", "GET", "GET", "POST", "PUT", "HEAD" };
+static const char *const paths[] = {
+  "/", "/index.html", "/static/app.js", "/api/v1/users", "/login",
+  "/search?q=grok&page=2", "/images/logo.png"
+};
+static const char *const agents[] = {
+  "Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 Chrome/120.0",
+  "curl/8.4.0", "python-requests/2.31.0", "Googlebot/2.1"
+};
+static const char *const levels[] = { "info", "info", "warn", "error", "debug" };
+static const char *const words[] = {
+  "started", "worker", "pool", "drained", "queue", "flush", "retry", "ok",
+  "connection", "closed", "timeout", "cache", "miss"
+};
+
+static void print_ip(void) {
+  printf("%d.%d.%d.%d", 10 + rng_below(200), rng_below(256), rng_below(256),
+         1 + rng_below(254));
+}
+
+static void print_syslog_header(void) {
+  printf("%s %2d %02d:%02d:%02d %s ", PICK(months), 1 + rng_below(28),
+         rng_below(24), rng_below(60), rng_below(60), PICK(hosts));
+}
+
+static void print_apache_prefix(void) {
+  print_ip();
+  printf(" - - [%02d/%s/2023:%02d:%02d:%02d +0000] \"%s %s HTTP/1.1\" %d %d ",
+         1 + rng_below(28), PICK(months), rng_below(24), rng_below(60),
+         rng_below(60), PICK(verbs), PICK(paths),
+         rng_below(10) ? 200 : 404, rng_below(90000));
+}
+
+static void print_kv_prefix(void) {
+  printf("ts=2023-%02d-%02dT%02d:%02d:%02dZ level=%s msg=\"%s %s\"",
+         1 + rng_below(12), 1 + rng_below(28), rng_below(24), rng_below(60),
+         rng_below(60), PICK(levels), PICK(words), PICK(words));
+}
+
+static void matching_line(void) {
+  switch (rng_below(3)) {
+    case 0:
+      print_syslog_header();
+      printf("%s[%d]: %s %s from ", PICK(programs), 100 + rng_below(60000),
+             PICK(words), PICK(words));
+      print_ip();
+      break;
+    case 1:
+      print_apache_prefix();
+      printf("\"-\" \"%s\"", PICK(agents));
+      break;
+    case 2:
+      print_kv_prefix();
+      printf(" latency_ms=%d status=%d", rng_below(1000),
+             rng_below(10) ? 200 : 500);
+      break;
+  }
+  putchar('\n');
+}
+
+static void noise_line(void) {
+  int i, n = 1 + rng_below(8);
+  for (i = 0; i < n; i++) {
+    printf("%s%s", i ? " " : "", PICK(words));
+  }
+  putchar('\n');
+}
+
+static void pathological_line(void) {
+  int i, n = 50 + rng_below(150);
+  switch (rng_below(3)) {
+    case 0:
+      /* every header starts a match that fails at the missing program */
+      for (i = 0; i < n; i++) {
+        print_syslog_header();
+      }
+      break;
+    case 1:
+      /* the agent's quote never closes */
+      print_apache_prefix();
+      printf("\"-\" \"");
+      for (i = 0; i < n; i++) {
+        printf("%s ", PICK(words));
+      }
+      break;
+    case 2:
+      /* key=value pairs go on and on, but status never comes */
+      print_kv_prefix();
+      for (i = 0; i < n; i++) {
+        printf(" latency_ms=%d", rng_below(1000));
+      }
+      break;
+  }
+  putchar('\n');
+}
+
+static void usage(const char *prog) {
+  fprintf(stderr,
+          "usage: %s [options] > corpus\n"
+          "  -n N  lines to write (default 100000)\n"
+          "  -s N  random seed (default 1)\n"
+          "  -m P  percentage of matching lines (default 90)\n"
+          "  -x P  percentage of pathological lines (default 1);\n"
+          "        the rest are noise\n",
+          prog);
+  exit(2);
+}
+
+int main(int argc, char **argv) {
+  long lines = 100000, i;
+  double match_pct = 90, pathological_pct = 1;
+  int opt;
+
+  rng_state = 1;
+  while ((opt = getopt(argc, argv, "n:s:m:x:h")) != -1) {
+    switch (opt) {
+      case 'n': lines = atol(optarg); break;
+      case 's': rng_state = strtoull(optarg, NULL, 10); break;
+      case 'm': match_pct = atof(optarg); break;
+      case 'x': pathological_pct = atof(optarg); break;
+      default: usage(argv[0]);
+    }
+  }
+  if (optind != argc || match_pct < 0 || pathological_pct < 0
+      || match_pct + pathological_pct > 100) {
+    usage(argv[0]);
+  }
+  /* xorshift gets stuck at zero */
+  rng_state = rng_state * 0x9E3779B97F4A7C15ULL + 1;
+
+  for (i = 0; i < lines; i++) {
+    double roll = (rng_next() >> 11) * (100.0 / 9007199254740992.0);
+    if (roll < match_pct) {
+      matching_line();
+    } else if (roll < match_pct + pathological_pct) {
+      pathological_line();
+    } else {
+      noise_line();
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,79 @@
+// Code generated by "grokbind -type s3Access"; DO NOT EDIT.
+
+package grok
+
+import (
+	"fmt"
+	"strconv"
+)
+
+// s3AccessBinder fills a s3Access from the captures of a Grok's matches. It's not
+// safe for concurrent use; make one per goroutine.
+type s3AccessBinder struct {
+	grok    *Grok
+	slots   [7]int
+	offsets []int
+}
+
+// newS3AccessBinder looks up s3Access's captures in g, which must already be compiled.
+func newS3AccessBinder(g *Grok) (*s3AccessBinder, error) {
+	binder := &s3AccessBinder{grok: g}
+	for i, name := range [...]string{"NOTSPACE:bucket", "clientip", "INT:response", "INT:bytes", "object_size", "NUMBER:httpversion", "QS:agent"} {
+		index := g.CaptureIndex(name)
+		if index < 0 {
+			return nil, fmt.Errorf("No capture named %s", name)
+		}
+		binder.slots[i] = 2 + index*2
+	}
+	return binder, nil
+}
+
+// Bind matches text and fills v from its captures, leaving fields whose
+// capture didn't take part in the match alone. It returns false if text
+// doesn't match. String fields refer to text.
+func (binder *s3AccessBinder) Bind(text string, v *s3Access) (bool, error) {
+	offsets := binder.grok.OffsetsString(text, binder.offsets)
+	if offsets == nil {
+		return false, nil
+	}
+	binder.offsets = offsets
+
+	if start := offsets[binder.slots[0]]; start >= 0 {
+		v.Bucket = text[start:offsets[binder.slots[0]+1]]
+	}
+	if start := offsets[binder.slots[1]]; start >= 0 {
+		v.ClientIP = text[start:offsets[binder.slots[1]+1]]
+	}
+	if start := offsets[binder.slots[2]]; start >= 0 {
+		n, err := strconv.ParseInt(text[start:offsets[binder.slots[2]+1]], 10, 0)
+		if err != nil {
+			return true, fmt.Errorf("Capture INT:response: %v", err)
+		}
+		v.Response = int(n)
+	}
+	if start := offsets[binder.slots[3]]; start >= 0 {
+		n, err := strconv.ParseInt(text[start:offsets[binder.slots[3]+1]], 10, 64)
+		if err != nil {
+			return true, fmt.Errorf("Capture INT:bytes: %v", err)
+		}
+		v.Bytes = n
+	}
+	if start := offsets[binder.slots[4]]; start >= 0 {
+		n, err := strconv.ParseUint(text[start:offsets[binder.slots[4]+1]], 10, 32)
+		if err != nil {
+			return true, fmt.Errorf("Capture object_size: %v", err)
+		}
+		v.ObjectSize = uint32(n)
+	}
+	if start := offsets[binder.slots[5]]; start >= 0 {
+		n, err := strconv.ParseFloat(text[start:offsets[binder.slots[5]+1]], 64)
+		if err != nil {
+			return true, fmt.Errorf("Capture NUMBER:httpversion: %v", err)
+		}
+		v.HTTPVersion = n
+	}
+	if start := offsets[binder.slots[6]]; start >= 0 {
+		v.Agent = text[start:offsets[binder.slots[6]+1]]
+	}
+	return true, nil
+}
@@ -0,0 +1,262 @@
+/* grokbind generates binders that copy a Grok's captures straight into
+   struct fields, for use with go:generate. Given
+
+	//go:generate grokbind -type S3Access -import path/to/grok
+	type S3Access struct {
+		Bucket   string `grok:"NOTSPACE:bucket"`
+		ClientIP string `grok:"clientip"`
+		Bytes    int64  `grok:"INT:bytes"`
+	}
+
+   it writes s3access_grok.go with an S3AccessBinder. NewS3AccessBinder
+   looks up each tagged capture in a compiled Grok once, and Bind matches a
+   line and fills the struct from the capture offsets, parsing numbers with
+   strconv: no map of captures, and no reflection.
+
+   Tags name a capture as Grok.CaptureIndex does, by full name or subname.
+   Fields can be strings, signed or unsigned integers, or floats. */
+package main
+
+import (
+	"bytes"
+	"errors"
+	"flag"
+	"fmt"
+	"go/ast"
+	"go/format"
+	"go/parser"
+	"go/token"
+	"go/types"
+	"os"
+	"reflect"
+	"strconv"
+	"strings"
+	"unicode"
+)
+
+var (
+	typeNames  = flag.String("type", "", "comma-separated struct types to generate binders for")
+	output     = flag.String("output", "", "output file; default <type>_grok.go")
+	importPath = flag.String("import", "", "import path of the grok package, unless generating into it")
+)
+
+/* A tagged struct field and the capture it's filled from */
+type field struct {
+	name    string
+	kind    string
+	capture string
+}
+
+/* How to parse each supported field type: the strconv function, its bit
+   size argument, and the conversion for the field if it isn't the parse
+   result's type */
+var kinds = map[string]struct {
+	parse   string
+	bits    int
+	convert bool
+}{
+	"string":  {"", 0, false},
+	"int":     {"ParseInt", 0, true},
+	"int8":    {"ParseInt", 8, true},
+	"int16":   {"ParseInt", 16, true},
+	"int32":   {"ParseInt", 32, true},
+	"int64":   {"ParseInt", 64, false},
+	"uint":    {"ParseUint", 0, true},
+	"uint8":   {"ParseUint", 8, true},
+	"uint16":  {"ParseUint", 16, true},
+	"uint32":  {"ParseUint", 32, true},
+	"uint64":  {"ParseUint", 64, false},
+	"float32": {"ParseFloat", 32, true},
+	"float64": {"ParseFloat", 64, false},
+}
+
+func main() {
+	flag.Parse()
+	if *typeNames == "" {
+		fmt.Fprintln(os.Stderr, "usage: grokbind -type T[,T...] [-output file] [-import path]")
+		os.Exit(2)
+	}
+	names := strings.Split(*typeNames, ",")
+
+	src, err := generate(".", names, *importPath)
+	if err != nil {
+		fmt.Fprintln(os.Stderr, "grokbind:", err)
+		os.Exit(1)
+	}
+
+	path := *output
+	if path == "" {
+		path = strings.ToLower(names[0]) + "_grok.go"
+	}
+	if err := os.WriteFile(path, src, 0644); err != nil {
+		fmt.Fprintln(os.Stderr, "grokbind:", err)
+		os.Exit(1)
+	}
+}
+
+/* Generate binders for typeNames, declared in the package in dir */
+func generate(dir string, typeNames []string, importPath string) ([]byte, error) {
+	fset := token.NewFileSet()
+	pkgs, err := parser.ParseDir(fset, dir, nil, 0)
+	if err != nil {
+		return nil, err
+	}
+
+	var pkgName string
+	structs := make(map[string][]field)
+	for name, pkg := range pkgs {
+		for _, file := range pkg.Files {
+			for _, decl := range file.Decls {
+				gen, ok := decl.(*ast.GenDecl)
+				if !ok || gen.Tok != token.TYPE {
+					continue
+				}
+				for _, spec := range gen.Specs {
+					ts := spec.(*ast.TypeSpec)
+					st, ok := ts.Type.(*ast.StructType)
+					if !ok || !contains(typeNames, ts.Name.Name) {
+						continue
+					}
+					fields, err := structFields(ts.Name.Name, st)
+					if err != nil {
+						return nil, err
+					}
+					structs[ts.Name.Name] = fields
+					pkgName = name
+				}
+			}
+		}
+	}
+
+	qualifier := ""
+	if pkgName != "grok" {
+		if importPath == "" {
+			return nil, errors.New("-import is needed outside the grok package")
+		}
+		qualifier = "grok."
+	}
+
+	var body bytes.Buffer
+	parses := false
+	for _, name := range typeNames {
+		fields, ok := structs[name]
+		if !ok {
+			return nil, fmt.Errorf("no struct type %s in %s", name, dir)
+		}
+		for _, f := range fields {
+			parses = parses || kinds[f.kind].parse != ""
+		}
+		writeBinder(&body, name, fields, qualifier)
+	}
+
+	var buf bytes.Buffer
+	fmt.Fprintf(&buf, "// Code generated by \"grokbind -type %s\"; DO NOT EDIT.\n\n", strings.Join(typeNames, ","))
+	fmt.Fprintf(&buf, "package %s\n\nimport (\n\t\"fmt\"\n", pkgName)
+	if parses {
+		fmt.Fprintf(&buf, "\t\"strconv\"\n")
+	}
+	if qualifier != "" {
+		fmt.Fprintf(&buf, "\n\tgrok %q\n", importPath)
+	}
+	fmt.Fprintf(&buf, ")\n")
+	buf.Write(body.Bytes())
+
+	return format.Source(buf.Bytes())
+}
+
+/* The tagged fields of a struct */
+func structFields(typeName string, st *ast.StructType) ([]field, error) {
+	var fields []field
+	for _, f := range st.Fields.List {
+		if f.Tag == nil {
+			continue
+		}
+		tag, err := strconv.Unquote(f.Tag.Value)
+		if err != nil {
+			return nil, err
+		}
+		capture, ok := reflect.StructTag(tag).Lookup("grok")
+		if !ok {
+			continue
+		}
+
+		ident, ok := f.Type.(*ast.Ident)
+		if ok {
+			_, ok = kinds[ident.Name]
+		}
+		if !ok {
+			return nil, fmt.Errorf("%s: can't bind a capture to a field of type %s", typeName, types.ExprString(f.Type))
+		}
+		for _, name := range f.Names {
+			fields = append(fields, field{name: name.Name, kind: ident.Name, capture: capture})
+		}
+	}
+	if len(fields) == 0 {
+		return nil, fmt.Errorf("%s has no fields with grok tags", typeName)
+	}
+	return fields, nil
+}
+
+func writeBinder(buf *bytes.Buffer, typeName string, fields []field, qualifier string) {
+	binder := typeName + "Binder"
+	constructor := "New" + binder
+	if !unicode.IsUpper([]rune(typeName)[0]) {
+		constructor = "new" + strings.ToUpper(binder[:1]) + binder[1:]
+	}
+
+	fmt.Fprintf(buf, "\n// %s fills a %s from the captures of a Grok's matches. It's not\n", binder, typeName)
+	fmt.Fprintf(buf, "// safe for concurrent use; make one per goroutine.\n")
+	fmt.Fprintf(buf, "type %s struct {\n\tgrok *%sGrok\n\tslots [%d]int\n\toffsets []int\n}\n\n", binder, qualifier, len(fields))
+
+	fmt.Fprintf(buf, "// %s looks up %s's captures in g, which must already be compiled.\n", constructor, typeName)
+	fmt.Fprintf(buf, "func %s(g *%sGrok) (*%s, error) {\n", constructor, qualifier, binder)
+	fmt.Fprintf(buf, "\tbinder := &%s{grok: g}\n\tfor i, name := range [...]string{", binder)
+	for i, f := range fields {
+		if i > 0 {
+			buf.WriteString(", ")
+		}
+		fmt.Fprintf(buf, "%q", f.capture)
+	}
+	fmt.Fprintf(buf, "} {\n\t\tindex := g.CaptureIndex(name)\n")
+	fmt.Fprintf(buf, "\t\tif index < 0 {\n\t\t\treturn nil, fmt.Errorf(\"No capture named %%s\", name)\n\t\t}\n")
+	fmt.Fprintf(buf, "\t\tbinder.slots[i] = 2 + index*2\n\t}\n\treturn binder, nil\n}\n\n")
+
+	fmt.Fprintf(buf, "// Bind matches text and fills v from its captures, leaving fields whose\n")
+	fmt.Fprintf(buf, "// capture didn't take part in the match alone. It returns false if text\n")
+	fmt.Fprintf(buf, "// doesn't match. String fields refer to text.\n")
+	fmt.Fprintf(buf, "func (binder *%s) Bind(text string, v *%s) (bool, error) {\n", binder, typeName)
+	fmt.Fprintf(buf, "\toffsets := binder.grok.OffsetsString(text, binder.offsets)\n")
+	fmt.Fprintf(buf, "\tif offsets == nil {\n\t\treturn false, nil\n\t}\n\tbinder.offsets = offsets\n\n")
+	for i, f := range fields {
+		kind := kinds[f.kind]
+		value := fmt.Sprintf("text[start:offsets[binder.slots[%d]+1]]", i)
+		fmt.Fprintf(buf, "\tif start := offsets[binder.slots[%d]]; start >= 0 {\n", i)
+		switch {
+		case kind.parse == "":
+			fmt.Fprintf(buf, "\t\tv.%s = %s\n", f.name, value)
+		default:
+			args := fmt.Sprintf("%s, %d", value, kind.bits)
+			if kind.parse != "ParseFloat" {
+				args = fmt.Sprintf("%s, 10, %d", value, kind.bits)
+			}
+			fmt.Fprintf(buf, "\t\tn, err := strconv.%s(%s)\n", kind.parse, args)
+			fmt.Fprintf(buf, "\t\tif err != nil {\n\t\t\treturn true, fmt.Errorf(\"Capture %s: %%v\", err)\n\t\t}\n", f.capture)
+			if kind.convert {
+				fmt.Fprintf(buf, "\t\tv.%s = %s(n)\n", f.name, f.kind)
+			} else {
+				fmt.Fprintf(buf, "\t\tv.%s = n\n", f.name)
+			}
+		}
+		fmt.Fprintf(buf, "\t}\n")
+	}
+	fmt.Fprintf(buf, "\treturn true, nil\n}\n")
+}
+
+func contains(list []string, s string) bool {
+	for _, item := range list {
+		if item == s {
+			return true
+		}
+	}
+	return false
+}
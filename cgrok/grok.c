@@ -19,10 +19,15 @@ grok_t *grok_new() {
 void grok_init(grok_t *grok) {
   //int ret;
   grok->re = NULL;
+  grok->re_extra = NULL;
   grok->pattern = NULL;
   grok->full_pattern = NULL;
   grok->pcre_num_captures = 0;
   grok->max_capture_num = 0;
+  grok->expansions = 0;
+  grok->max_expand_depth = 0;
+  grok->predicates = NULL;
+  grok->npredicates = 0;
   grok->pcre_errptr = NULL;
   grok->pcre_erroffset = 0;
   grok->logmask = 0;
@@ -63,11 +68,16 @@ void grok_init(grok_t *grok) {
     g_cap_subname = pcre_get_stringnumber(g_pattern_re, "subname");
     g_cap_predicate = pcre_get_stringnumber(g_pattern_re, "predicate");
     g_cap_definition = pcre_get_stringnumber(g_pattern_re, "definition");
+
+    pcre_callout = grok_capture_callout;
   }
 }
 
 void grok_clone(grok_t *dst, const grok_t *src) {
   grok_init(dst);
+#ifndef GROK_TEST_NO_PATTERNS
+  tctreedel(dst->patterns);
+#endif /* GROK_TEST_NO_PATTERNS */
   dst->patterns = src->patterns;
   dst->logmask = src->logmask;
   dst->logdepth = src->logdepth + 1;
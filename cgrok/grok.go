@@ -4,13 +4,66 @@ package grok
 #cgo CFLAGS: -I. -std=gnu99
 #cgo windows LDFLAGS: -L. -lws2_32
 #include "grok.h"
+#include "predicates.h"
+
+// The lines of one buffer that matched, collected by Grok.Scan so that a
+// whole buffer crosses into C once. For each matched line, lines holds its
+// index in the buffer, offset and length, and vectors the first two thirds
+// of its capture vector.
+typedef struct scan_batch {
+  const char *buf;
+  int *lines;
+  int *vectors;
+  int nlines, nmatched, size;
+  int vector_len;
+} scan_batch_t;
+
+static int scan_batch_add(const grok_t *grok, const char *line, int line_len,
+                          int ret, const int *vector, void *data) {
+  scan_batch_t *batch = data;
+  if (ret == GROK_OK) {
+    if (batch->nmatched == batch->size) {
+      batch->size = batch->size ? batch->size * 2 : 256;
+      batch->lines = realloc(batch->lines, batch->size * 3 * sizeof(int));
+      batch->vectors = realloc(batch->vectors,
+                               batch->size * batch->vector_len * sizeof(int));
+    }
+    batch->lines[batch->nmatched * 3] = batch->nlines;
+    batch->lines[batch->nmatched * 3 + 1] = line - batch->buf;
+    batch->lines[batch->nmatched * 3 + 2] = line_len;
+    memcpy(batch->vectors + batch->nmatched * batch->vector_len, vector,
+           batch->vector_len * sizeof(int));
+    batch->nmatched++;
+  }
+  batch->nlines++;
+  return 0;
+}
+
+static int scan_batch_buffer(const grok_t *grok, const char *buf, int len,
+                             int final, scan_batch_t *batch) {
+  batch->buf = buf;
+  batch->nlines = 0;
+  batch->nmatched = 0;
+  batch->vector_len = grok->pcre_num_captures * 2;
+  return grok_scan_buffer(grok, buf, len, final, scan_batch_add, batch);
+}
+
+static void scan_batch_free(scan_batch_t *batch) {
+  free(batch->lines);
+  free(batch->vectors);
+}
 */
 import "C"
 
 import (
+	"bufio"
 	"errors"
 	"fmt"
+	"io"
+	"runtime"
+	"strings"
 	"sync"
+	"sync/atomic"
 	"unsafe"
 )
 
@@ -29,8 +82,27 @@ type Grok struct {
 	g               *C.grok_t
 	stringCacheLock sync.RWMutex
 	stringCache     map[uintptr]string
+
+	/* Named captures in walk order, for MatchBytes and friends. Built on
+	   first use and dropped by Compile. */
+	captureLock  sync.RWMutex
+	captureIndex []captureIndex
+
+	/* Spare PCRE capture vectors, as *[]C.int */
+	vectors sync.Pool
 }
 
+/* A named capture and its PCRE capture number */
+type captureIndex struct {
+	name    string
+	subname string
+	number  int
+}
+
+/* Passed to C in place of an empty []byte, which has no first byte to
+   point at */
+var emptySubject byte
+
 type Match struct {
 	gm      C.grok_match_t
 	grok    *Grok
@@ -43,12 +115,112 @@ type Match struct {
 	gsubstring                 string
 	name                       *C.char
 	namelen, suboffset, sublen C.int
+
+	/* Sizes of the C copy of the subject and the capture vector in gm,
+	   which MatchInto keeps for the next match if they're big enough */
+	subjectSize, vectorSize int
+}
+
+/* Size and complexity of a compiled pattern, see grok_compile_stats */
+type CompileStats struct {
+	PatternLen           int
+	FullPatternLen       int
+	Expansions           int
+	MaxDepth             int
+	CaptureCount         int
+	CompiledSize         int
+	StudySize            int
+	FirstByte            int
+	FirstByteCaseless    bool
+	RequiredByte         int
+	RequiredByteCaseless bool
+	HasStartBits         bool
+	Anchored             bool
 }
 
 type Pile struct {
 	Patterns     map[string]string
 	PatternFiles []string
 	Groks        []*Grok
+
+	/* The C pile owns the Groks and the pattern library they share, and
+	   evaluates all of them in one pass. It's rebuilt lazily on the first
+	   Match after a Compile. */
+	p        *C.grok_pile_t
+	lock     sync.RWMutex
+	compiled bool
+
+	/* How many of PatternFiles are in the C pattern library */
+	imported int
+
+	/* Calls to Match, to schedule reorders */
+	matches uint32
+}
+
+/* Finds known patterns in text, see Grok.NewDiscoverer */
+type Discoverer struct {
+	d *C.grok_discover_t
+}
+
+/* Learns patterns for lines a Pile doesn't match, see
+   Pile.NewStreamDiscoverer */
+type StreamDiscoverer struct {
+	pile       *Pile
+	discoverer *Discoverer
+	lock       sync.Mutex
+
+	/* Lines no Grok matched since the last learn, up to bufferSize */
+	unmatched  []string
+	bufferSize int
+
+	/* Patterns learned so far, as a set and in order */
+	learned  map[string]bool
+	patterns []string
+}
+
+/* Mines line templates, see Grok.NewTemplateMiner */
+type TemplateMiner struct {
+	d    C.grok_drain_t
+	lock sync.Mutex
+}
+
+/* A template mined by a TemplateMiner, as a grok expression, and the
+   number of lines merged into it */
+type Template struct {
+	Pattern string
+	Lines   int
+}
+
+/* A pattern suggested by Discoverer.DiscoverCorpus. Lines is the number of
+   lines it was discovered from, Matched how many of those it matches, and
+   Representative the index of the line it came from. */
+type DiscoveredPattern struct {
+	Pattern        string
+	Lines          int
+	Matched        int
+	Representative int
+}
+
+/* The outcome of matching one line with MatchParallel. If Matched,
+   Offsets holds the start and end of the whole match and then of each
+   capture, as from OffsetsBytes. */
+type Result struct {
+	Matched bool
+	Offsets []int
+}
+
+/* How many lines a MatchParallel worker claims at a time */
+const parallelBatchSize = 64
+
+/* How many matches a Pile sees between attempts to move frequently
+   matching Groks to the front */
+const pileReorderInterval = 4096
+
+/* Per-Grok counters of a Pile, see Pile.Stats */
+type PileStats struct {
+	Hits     uint64
+	Misses   uint64
+	Position int
 }
 
 func New() *Grok {
@@ -103,6 +275,10 @@ func (grok *Grok) Compile(pattern string, onlyRenamed bool) error {
 	p := C.CString(pattern)
 	defer C.free(unsafe.Pointer(p))
 
+	grok.captureLock.Lock()
+	grok.captureIndex = nil
+	grok.captureLock.Unlock()
+
 	ret := C.grok_compile(grok.g, p, C.int(boolToInt(onlyRenamed)))
 	if ret != GROK_OK {
 		return errors.New(fmt.Sprintf("Failed to compile: %s", C.GoString(grok.g.errstr)))
@@ -111,39 +287,538 @@ func (grok *Grok) Compile(pattern string, onlyRenamed bool) error {
 	return nil
 }
 
+/* Report statistics about the last compiled pattern. FirstByte follows PCRE's
+   convention: -1 means "only at the start of a line" and -2 means unknown.
+   RequiredByte is -1 when there is no such byte. */
+func (grok *Grok) CompileStats() (*CompileStats, error) {
+	var cstats C.grok_compile_stats_t
+
+	ret := C.grok_compile_stats(grok.g, &cstats)
+	if ret != GROK_OK {
+		return nil, errors.New("No pattern has been compiled")
+	}
+
+	return &CompileStats{
+		PatternLen:           int(cstats.pattern_len),
+		FullPatternLen:       int(cstats.full_pattern_len),
+		Expansions:           int(cstats.expansions),
+		MaxDepth:             int(cstats.max_depth),
+		CaptureCount:         int(cstats.capture_count),
+		CompiledSize:         int(cstats.compiled_size),
+		StudySize:            int(cstats.study_size),
+		FirstByte:            int(cstats.first_byte),
+		FirstByteCaseless:    cstats.first_byte_caseless != 0,
+		RequiredByte:         int(cstats.required_byte),
+		RequiredByteCaseless: cstats.required_byte_caseless != 0,
+		HasStartBits:         cstats.has_start_bits != 0,
+		Anchored:             cstats.anchored != 0,
+	}, nil
+}
+
+/* Expand the %{FOO}s in pattern into the plain regexp they stand for, as
+   regexp predicates do: as non-capturing groups, with any predicates
+   dropped. The Grok's compiled pattern and captures are left alone. */
+func (grok *Grok) Expand(pattern string) (string, error) {
+	p := C.CString(pattern)
+	defer C.free(unsafe.Pointer(p))
+
+	var length C.int
+	expanded := C.grok_expand_match_only(grok.g, p, C.int(len(pattern)), &length)
+	if expanded == nil {
+		return "", errors.New(fmt.Sprintf("Failed to expand: %s", C.GoString(grok.g.errstr)))
+	}
+	defer C.free(unsafe.Pointer(expanded))
+	return C.GoStringN(expanded, length), nil
+}
+
+/* The number of compiled regexps that =~ and !~ predicates share across
+   every Grok in the process. Predicates with the same expanded regexp and
+   sense use one, which lives until the process exits. */
+func RegexpPredicateCacheSize() int {
+	return int(C.grok_predicate_regexp_cache_size())
+}
+
 /* Note that Matches must be freed after use, to free the C string
    used for matching and the PCRE vector */
 func (grok *Grok) Match(text string) *Match {
-	t := C.CString(text)
+	match := new(Match)
+	if !grok.MatchInto(match, text) {
+		match.Free()
+		return nil
+	}
+	return match
+}
 
-	var cmatch C.grok_match_t
+/* Match text into an existing Match, which may be a zero Match or one
+   returned by an earlier Match or MatchInto, from any Grok. The C copy of
+   the subject and the capture vector are reused when they're big enough,
+   so matching with a recycled Match allocates nothing. Returns false if
+   text doesn't match, leaving match empty. The Match still has to be
+   freed when it's no longer needed. */
+func (grok *Grok) MatchInto(match *Match, text string) bool {
+	match.Reset()
 
-	ret := C.grok_exec(grok.g, t, &cmatch)
+	size := int(grok.g.pcre_num_captures) * 3
+	if size < 3 {
+		size = 3
+	}
+	if match.vectorSize < size {
+		if match.gm.pcre_capture_vector != nil {
+			C.free(unsafe.Pointer(match.gm.pcre_capture_vector))
+		}
+		match.gm.pcre_capture_vector = (*C.int)(C.malloc(C.size_t(size) * C.sizeof_int))
+		match.vectorSize = size
+	}
+
+	if match.subjectSize < len(text)+1 {
+		size := 2 * match.subjectSize
+		if size < len(text)+1 {
+			size = len(text) + 1
+		}
+		if match.gm.subject != nil {
+			C.free(unsafe.Pointer(match.gm.subject))
+		}
+		match.gm.subject = (*C.char)(C.malloc(C.size_t(size)))
+		match.subjectSize = size
+	}
+	subject := unsafe.Slice((*byte)(unsafe.Pointer(match.gm.subject)), len(text)+1)
+	copy(subject, text)
+	subject[len(text)] = 0
+
+	ret := C.grok_execn_vector(grok.g, match.gm.subject, C.int(len(text)),
+		match.gm.pcre_capture_vector, C.int(match.vectorSize))
 	if ret != GROK_OK {
-		C.free(unsafe.Pointer(t))
+		return false
+	}
+
+	vector := unsafe.Slice(match.gm.pcre_capture_vector, 2)
+	match.gm.grok = grok.g
+	match.gm.start = vector[0]
+	match.gm.end = vector[1]
+	match.grok = grok
+	match.subject = text
+	return true
+}
+
+/* Report whether b matches. Unlike Match, b is passed to C as it is,
+   without copying it or allocating anything. */
+func (grok *Grok) MatchBytes(b []byte) bool {
+	vector := grok.getVector()
+	defer grok.vectors.Put(vector)
+	return grok.execBytes(b, *vector)
+}
+
+/* Match b and return its captures, like Match(...).Captures(). The
+   captured values are subslices of b, so they change if b is reused.
+   Returns nil if b doesn't match. */
+func (grok *Grok) CapturesBytes(b []byte) map[string][][]byte {
+	vector := grok.getVector()
+	defer grok.vectors.Put(vector)
+	if !grok.execBytes(b, *vector) {
+		return nil
+	}
+
+	captures := make(map[string][][]byte)
+	for _, capture := range grok.captures() {
+		var value []byte
+		start, end := int((*vector)[capture.number*2]), int((*vector)[capture.number*2+1])
+		if start >= 0 {
+			value = b[start:end:end]
+		}
+		captures[capture.name] = append(captures[capture.name], value)
+	}
+	return captures
+}
+
+/* Match b and append the start and end offsets of the whole match to
+   offsets, followed by those of each capture in CaptureNames order, with
+   -1 for captures that didn't take part in the match. With an offsets
+   slice that has room, nothing is allocated. Returns nil if b doesn't
+   match. */
+func (grok *Grok) OffsetsBytes(b []byte, offsets []int) []int {
+	vector := grok.getVector()
+	defer grok.vectors.Put(vector)
+	if !grok.execBytes(b, *vector) {
+		return nil
+	}
+
+	return appendOffsets(offsets[:0], *vector, grok.captures())
+}
+
+/* Like OffsetsBytes, for a string */
+func (grok *Grok) OffsetsString(text string, offsets []int) []int {
+	vector := grok.getVector()
+	defer grok.vectors.Put(vector)
+	if !grok.execString(text, *vector) {
 		return nil
 	}
 
+	return appendOffsets(offsets[:0], *vector, grok.captures())
+}
+
+/* Append the whole match's offsets, then each capture's, from vector */
+func appendOffsets(offsets []int, vector []C.int, captures []captureIndex) []int {
+	offsets = append(offsets, int(vector[0]), int(vector[1]))
+	for _, capture := range captures {
+		offsets = append(offsets, int(vector[capture.number*2]),
+			int(vector[capture.number*2+1]))
+	}
+	return offsets
+}
+
+/* The names of the compiled pattern's captures, in the order OffsetsBytes
+   reports them */
+func (grok *Grok) CaptureNames() []string {
+	captures := grok.captures()
+	names := make([]string, len(captures))
+	for i, capture := range captures {
+		names[i] = capture.name
+	}
+	return names
+}
+
+/* The index in CaptureNames of the first capture with this name, like
+   "INT:bytes", or with this subname, like "bytes". Returns -1 if there's
+   no such capture. */
+func (grok *Grok) CaptureIndex(name string) int {
+	for i, capture := range grok.captures() {
+		if capture.name == name || capture.subname == name {
+			return i
+		}
+	}
+	return -1
+}
+
+/* Run the compiled pattern over b in place, leaving the capture vector
+   in vector */
+func (grok *Grok) execBytes(b []byte, vector []C.int) bool {
+	if len(b) == 0 {
+		return grok.exec(unsafe.Pointer(&emptySubject), 0, vector)
+	}
+	return grok.exec(unsafe.Pointer(&b[0]), len(b), vector)
+}
+
+/* Like execBytes, for a string */
+func (grok *Grok) execString(text string, vector []C.int) bool {
+	if len(text) == 0 {
+		return grok.exec(unsafe.Pointer(&emptySubject), 0, vector)
+	}
+	return grok.exec(unsafe.Pointer(unsafe.StringData(text)), len(text), vector)
+}
+
+func (grok *Grok) exec(text unsafe.Pointer, length int, vector []C.int) bool {
+	return C.grok_execn_vector(grok.g, (*C.char)(text), C.int(length),
+		&vector[0], C.int(len(vector))) == GROK_OK
+}
+
+/* Take a capture vector big enough for the compiled pattern from the pool.
+   Put it back when done. */
+func (grok *Grok) getVector() *[]C.int {
+	size := int(grok.g.pcre_num_captures) * 3
+	if size < 3 {
+		size = 3
+	}
+	vector, _ := grok.vectors.Get().(*[]C.int)
+	if vector == nil || len(*vector) < size {
+		v := make([]C.int, size)
+		vector = &v
+	}
+	return vector
+}
+
+/* The compiled pattern's named captures, built on first use */
+func (grok *Grok) captures() []captureIndex {
+	grok.captureLock.RLock()
+	captures := grok.captureIndex
+	grok.captureLock.RUnlock()
+	if captures != nil {
+		return captures
+	}
+
+	grok.captureLock.Lock()
+	defer grok.captureLock.Unlock()
+	if grok.captureIndex == nil {
+		captures = make([]captureIndex, 0)
+		iter := C.grok_capture_walk_init(grok.g)
+		for {
+			gct := C.grok_capture_walk_next(iter, grok.g)
+			if gct == nil {
+				break
+			}
+			captures = append(captures, captureIndex{
+				name:    C.GoStringN(gct.name, gct.name_len),
+				subname: C.GoStringN(gct.subname, gct.subname_len),
+				number:  int(gct.pcre_capture_number),
+			})
+		}
+		C.tctreeiterfree(iter)
+		grok.captureIndex = captures
+	}
+	return grok.captureIndex
+}
+
+/* Match lines on several goroutines, storing the outcome for lines[i] in
+   out[i]. out is grown to len(lines) if it's too short, and returned; the
+   Offsets slices in it are reused, so matching batch after batch into the
+   same out only allocates per call, not per line. workers defaults to
+   GOMAXPROCS if it's not positive.
+
+   Workers claim parallelBatchSize lines at a time, and each has its own
+   capture vector, so the only thing they share is the counter of lines
+   claimed so far. */
+func (grok *Grok) MatchParallel(lines []string, workers int, out []Result) []Result {
+	if cap(out) < len(lines) {
+		out = append(out[:cap(out)], make([]Result, len(lines)-cap(out))...)
+	}
+	out = out[:len(lines)]
+
+	if workers <= 0 {
+		workers = runtime.GOMAXPROCS(0)
+	}
+	if batches := (len(lines) + parallelBatchSize - 1) / parallelBatchSize; workers > batches {
+		workers = batches
+	}
+
+	captures := grok.captures()
+	var claimed int64
+	var wg sync.WaitGroup
+	worker := func() {
+		defer wg.Done()
+		vector := grok.getVector()
+		defer grok.vectors.Put(vector)
+		for {
+			end := int(atomic.AddInt64(&claimed, parallelBatchSize))
+			start := end - parallelBatchSize
+			if start >= len(lines) {
+				return
+			}
+			if end > len(lines) {
+				end = len(lines)
+			}
+			for i := start; i < end; i++ {
+				result := &out[i]
+				result.Offsets = result.Offsets[:0]
+				result.Matched = grok.execString(lines[i], *vector)
+				if result.Matched {
+					result.Offsets = appendOffsets(result.Offsets, *vector, captures)
+				}
+			}
+		}
+	}
+
+	wg.Add(workers)
+	for i := 1; i < workers; i++ {
+		go worker()
+	}
+	if workers > 0 {
+		worker()
+	}
+	wg.Wait()
+	return out
+}
+
+/* How much of a Reader Scan reads at a time. Lines longer than this grow
+   the buffer. */
+const scanBufferSize = 1 << 20
+
+/* Match each line read from r, calling fn with the line number, counting
+   from 1, of each line that matches. Lines end with "\n" or "\r\n", and
+   the last one may have no newline.
+
+   Lines are read into a C buffer and split and matched a buffer at a time,
+   so there's no cgo call or copy per line. In exchange, fn is always given
+   the same Match, which is only valid until fn returns: its subject, and
+   the strings Group returns, are in the read buffer. Copy anything that's
+   needed later, as Captures does. The Match must not be freed or passed to
+   MatchInto. */
+func (grok *Grok) Scan(r io.Reader, fn func(lineNo int, m *Match)) error {
+	if grok.g.re == nil {
+		return errors.New("No pattern has been compiled")
+	}
+
+	size := scanBufferSize
+	buf := C.malloc(C.size_t(size))
+	defer func() { C.free(buf) }()
+
+	var batch C.scan_batch_t
+	defer C.scan_batch_free(&batch)
+
 	match := new(Match)
-	match.gm = cmatch
 	match.grok = grok
-	match.subject = text
-	return match
+	match.gm.grok = grok.g
+
+	lineNo := 0
+	filled := 0
+	for eof := false; !eof; {
+		n, err := r.Read(unsafe.Slice((*byte)(buf), size)[filled:])
+		filled += n
+		if err == io.EOF {
+			eof = true
+		} else if err != nil {
+			return err
+		} else if n == 0 {
+			continue
+		}
+
+		consumed := int(C.scan_batch_buffer(grok.g, (*C.char)(buf), C.int(filled),
+			C.int(boolToInt(eof)), &batch))
+
+		vectorLen := int(batch.vector_len)
+		lines := unsafe.Slice(batch.lines, int(batch.nmatched)*3)
+		for i := 0; i < int(batch.nmatched); i++ {
+			subject := unsafe.Add(buf, int(lines[i*3+1]))
+			vector := unsafe.Add(unsafe.Pointer(batch.vectors), i*vectorLen*C.sizeof_int)
+
+			match.gm.subject = (*C.char)(subject)
+			match.gm.pcre_capture_vector = (*C.int)(vector)
+			match.gm.start = *(*C.int)(vector)
+			match.gm.end = *(*C.int)(unsafe.Add(vector, C.sizeof_int))
+			match.subject = unsafe.String((*byte)(subject), int(lines[i*3+2]))
+			match.err = nil
+			fn(lineNo+int(lines[i*3])+1, match)
+			C.grok_match_walk_end(&match.gm)
+		}
+		lineNo += int(batch.nlines)
+
+		/* Move the unfinished last line to the front, and make room for
+		   the rest of it if it fills the buffer */
+		filled -= consumed
+		C.memmove(buf, unsafe.Add(buf, consumed), C.size_t(filled))
+		if filled == size {
+			size *= 2
+			buf = C.realloc(buf, C.size_t(size))
+		}
+	}
+
+	match.gm.subject = nil
+	match.gm.pcre_capture_vector = nil
+	return nil
 }
 
+/* Find known patterns in text. This compiles the whole pattern library
+   each time; to discover patterns in many lines, use a Discoverer. */
 func (grok *Grok) Discover(text string) string {
+	discoverer := grok.NewDiscoverer()
+	defer discoverer.Free()
+
+	return discoverer.Discover(text)
+}
+
+/* Create a Discoverer for the Grok's pattern library. Patterns added to the
+   Grok afterwards aren't used, and the Grok must not be freed before the
+   Discoverer is. */
+func (grok *Grok) NewDiscoverer() *Discoverer {
+	discoverer := new(Discoverer)
+	discoverer.d = C.grok_discover_new(grok.g)
+	return discoverer
+}
+
+/* Replace known patterns in text with %{NAME} references. Safe to call from
+   multiple goroutines at once. */
+func (discoverer *Discoverer) Discover(text string) string {
 	ctext := C.CString(text)
 	defer C.free(unsafe.Pointer(ctext))
 
-	gdt := C.grok_discover_new(grok.g)
 	var discovery *C.char
 	var discoverylen C.int
 
-	C.grok_discover(gdt, ctext, &discovery, &discoverylen)
+	C.grok_discover(discoverer.d, ctext, &discovery, &discoverylen)
+	defer C.free(unsafe.Pointer(discovery))
 
 	return C.GoStringN(discovery, discoverylen)
 }
 
+/* Suggest patterns for a corpus of lines, see grok_discover_corpus.
+   workers is the number of threads to use, or 0 for one per CPU. */
+func (discoverer *Discoverer) DiscoverCorpus(lines []string, workers int) []DiscoveredPattern {
+	if len(lines) == 0 {
+		return nil
+	}
+
+	/* One C copy of the corpus, and pointers into it */
+	buf := C.CString(strings.Join(lines, ""))
+	defer C.free(unsafe.Pointer(buf))
+	clines := C.malloc(C.size_t(len(lines)) * C.size_t(unsafe.Sizeof(buf)))
+	defer C.free(clines)
+	clens := C.malloc(C.size_t(len(lines)) * C.size_t(unsafe.Sizeof(C.int(0))))
+	defer C.free(clens)
+	linePtrs := unsafe.Slice((**C.char)(clines), len(lines))
+	lineLens := unsafe.Slice((*C.int)(clens), len(lines))
+	offset := 0
+	for i, line := range lines {
+		linePtrs[i] = (*C.char)(unsafe.Add(unsafe.Pointer(buf), offset))
+		lineLens[i] = C.int(len(line))
+		offset += len(line)
+	}
+
+	var cresults *C.grok_discover_result_t
+	n := int(C.grok_discover_corpus(discoverer.d, (**C.char)(clines),
+		(*C.int)(clens), C.int(len(lines)), C.int(workers), &cresults))
+	defer C.grok_discover_results_free(cresults, C.int(n))
+
+	results := make([]DiscoveredPattern, n)
+	cslice := unsafe.Slice(cresults, n)
+	for i, r := range cslice {
+		results[i] = DiscoveredPattern{
+			Pattern:        C.GoStringN(r.pattern, r.pattern_len),
+			Lines:          int(r.lines),
+			Matched:        int(r.matched),
+			Representative: int(r.representative),
+		}
+	}
+	return results
+}
+
+/* Create a TemplateMiner, a much faster alternative to discovery for large
+   volumes of unknown lines, see grok_drain_t. Lines are routed by their
+   first depth tokens, and merged into a template when at least the
+   similarity fraction of their tokens match it. Wildcards are typed with
+   the Grok's patterns, so it must outlive the miner. */
+func (grok *Grok) NewTemplateMiner(depth int, similarity float64) *TemplateMiner {
+	miner := new(TemplateMiner)
+	C.grok_drain_init(&miner.d, grok.g, C.int(depth), C.double(similarity))
+	return miner
+}
+
+/* Merge a line into the templates, returning the index of its template */
+func (miner *TemplateMiner) Add(line string) int {
+	cline := C.CString(line)
+	defer C.free(unsafe.Pointer(cline))
+
+	miner.lock.Lock()
+	defer miner.lock.Unlock()
+	return int(C.grok_drain_add(&miner.d, cline, C.int(len(line))))
+}
+
+/* The templates mined so far, in the order they were created */
+func (miner *TemplateMiner) Templates() []Template {
+	miner.lock.Lock()
+	defer miner.lock.Unlock()
+
+	n := int(miner.d.ntemplates)
+	templates := make([]Template, n)
+	if n == 0 {
+		return templates
+	}
+	ctemplates := unsafe.Slice(miner.d.templates, n)
+	for i := range templates {
+		var pattern *C.char
+		var patternlen C.int
+		C.grok_drain_pattern(&miner.d, C.int(i), &pattern, &patternlen)
+		templates[i] = Template{C.GoStringN(pattern, patternlen), int(ctemplates[i].count)}
+		C.free(unsafe.Pointer(pattern))
+	}
+	return templates
+}
+
+func (miner *TemplateMiner) Free() {
+	C.grok_drain_clean(&miner.d)
+}
+
+func (discoverer *Discoverer) Free() {
+	C.grok_discover_free(discoverer.d)
+}
+
 func (grok *Grok) Free() {
 	C.grok_free(grok.g)
 }
@@ -153,57 +828,273 @@ func NewPile() *Pile {
 	pile.Patterns = make(map[string]string)
 	pile.PatternFiles = make([]string, 0)
 	pile.Groks = make([]*Grok, 0)
+	pile.p = C.grok_pile_new()
 
 	return pile
 }
 
+/* Free the Pile and all of its Groks. */
 func (pile *Pile) Free() {
-	for _, grok := range pile.Groks {
-		grok.Free()
-	}
+	C.grok_pile_free(pile.p)
 }
 
 func (pile *Pile) AddPattern(name, str string) {
+	cname := C.CString(name)
+	cstr := C.CString(str)
+	defer C.free(unsafe.Pointer(cname))
+	defer C.free(unsafe.Pointer(cstr))
+
+	pile.lock.Lock()
 	pile.Patterns[name] = str
+	C.grok_pattern_add(&pile.p.library, cname, C.strlen(cname), cstr, C.strlen(cstr))
+	pile.lock.Unlock()
 }
 
 func (pile *Pile) Compile(pattern string, onlyRenamed bool) error {
-	grok := New()
-	if grok == nil {
-		return errors.New("Unable to initialize grok!")
-	}
+	return pile.compile(pattern, onlyRenamed, 0)
+}
+
+/* Like Compile, but the Grok's priority relative to other order-insensitive
+   Groks doesn't matter: the Pile may try them in whichever order matches
+   fastest. */
+func (pile *Pile) CompileOrderInsensitive(pattern string, onlyRenamed bool) error {
+	return pile.compile(pattern, onlyRenamed, C.GROK_PILE_ORDER_INSENSITIVE)
+}
 
-	for name, value := range pile.Patterns {
-		grok.AddPattern(name, value)
+/* Compile a pattern against the Pile's shared pattern library. The Grok
+   belongs to the Pile and is freed with it. */
+func (pile *Pile) compile(pattern string, onlyRenamed bool, flags C.int) error {
+	pile.lock.Lock()
+	defer pile.lock.Unlock()
+
+	if err := pile.importPatternFiles(); err != nil {
+		return err
 	}
 
-	for _, path := range pile.PatternFiles {
-		if err := grok.AddPatternsFromFile(path); err != nil {
-			return err
-		}
+	p := C.CString(pattern)
+	defer C.free(unsafe.Pointer(p))
+
+	ret := C.grok_pile_add_pattern(pile.p, p, C.int(len(pattern)),
+		C.int(boolToInt(onlyRenamed)), flags)
+	if ret != GROK_OK {
+		return errors.New(fmt.Sprintf("Failed to compile: %s", C.GoString(pile.p.errstr)))
 	}
 
-	grok.Compile(pattern, onlyRenamed)
+	grok := new(Grok)
+	grok.g = (*C.grok_t)(unsafe.Pointer(C.grok_pile_member(pile.p, pile.p.nmembers-1)))
+	grok.stringCache = make(map[uintptr]string)
 	pile.Groks = append(pile.Groks, grok)
+	pile.compiled = false
+
+	return nil
+}
 
+/* Load any pending PatternFiles into the C library. The caller holds the
+   write lock. */
+func (pile *Pile) importPatternFiles() error {
+	for ; pile.imported < len(pile.PatternFiles); pile.imported++ {
+		path := pile.PatternFiles[pile.imported]
+		cpath := C.CString(path)
+		ret := C.grok_patterns_import_from_file(&pile.p.library, cpath)
+		C.free(unsafe.Pointer(cpath))
+		if ret != GROK_OK {
+			return errors.New(fmt.Sprintf("Failed to add path %s", path))
+		}
+	}
 	return nil
 }
 
+/* Patterns from path are loaded into the shared library by the next
+   Compile. */
 func (pile *Pile) AddPatternsFromFile(path string) {
+	pile.lock.Lock()
 	pile.PatternFiles = append(pile.PatternFiles, path)
+	pile.lock.Unlock()
 }
 
+/* Find the first Grok, in the order they were compiled, that matches str.
+   All of the Groks are tried in a single call into C. */
 func (pile *Pile) Match(str string) (*Grok, *Match) {
-	for _, grok := range pile.Groks {
-		match := grok.Match(str)
-		if match != nil {
-			return grok, match
+	if atomic.AddUint32(&pile.matches, 1)%pileReorderInterval == 0 {
+		pile.Reorder()
+	}
+
+	pile.lock.RLock()
+	if !pile.compiled {
+		pile.lock.RUnlock()
+		pile.lock.Lock()
+		if !pile.compiled {
+			C.grok_pile_compile(pile.p)
+			pile.compiled = true
 		}
+		pile.lock.Unlock()
+		pile.lock.RLock()
+	}
+	defer pile.lock.RUnlock()
+
+	t := C.CString(str)
+
+	var cmatch C.grok_match_t
+	var member C.int
+
+	ret := C.grok_pile_execn(pile.p, t, C.int(len(str)), &member, &cmatch)
+	if ret != GROK_OK {
+		C.free(unsafe.Pointer(t))
+		return nil, nil
+	}
+
+	grok := pile.Groks[int(member)]
+	match := new(Match)
+	match.gm = cmatch
+	match.grok = grok
+	match.subject = str
+	return grok, match
+}
+
+/* Move the Groks that match most often to the front of the evaluation
+   order, where that can't change which Grok matches a line. Match does this
+   periodically by itself. */
+func (pile *Pile) Reorder() {
+	pile.lock.Lock()
+	defer pile.lock.Unlock()
+	if pile.compiled {
+		C.grok_pile_reorder(pile.p)
+	}
+}
+
+/* Hit and miss counts for each Grok, in the same order as pile.Groks. A
+   miss is a line the Grok was tried on, or ruled out for, without matching. */
+func (pile *Pile) Stats() []PileStats {
+	pile.lock.RLock()
+	defer pile.lock.RUnlock()
+
+	stats := make([]PileStats, len(pile.Groks))
+	for i := range stats {
+		var hits, misses C.uint64_t
+		var position C.int
+		C.grok_pile_member_stats(pile.p, C.int(i), &hits, &misses, &position)
+		stats[i] = PileStats{uint64(hits), uint64(misses), int(position)}
+	}
+	return stats
+}
+
+/* How many lines the line shape cache sent straight to the Grok that
+   matched, and how many it guessed wrong. Only Groks added with
+   CompileOrderInsensitive are ever cached. */
+func (pile *Pile) ShapeCacheStats() (hits, misses uint64) {
+	var chits, cmisses C.uint64_t
+	C.grok_pile_shape_stats(pile.p, &chits, &cmisses)
+	return uint64(chits), uint64(cmisses)
+}
+
+/* Create a StreamDiscoverer that learns patterns for lines none of the
+   Pile's Groks match, bufferSize lines at a time. It discovers with the
+   Pile's pattern library as it is now, and must be freed before the Pile. */
+func (pile *Pile) NewStreamDiscoverer(bufferSize int) (*StreamDiscoverer, error) {
+	pile.lock.Lock()
+	defer pile.lock.Unlock()
+
+	if err := pile.importPatternFiles(); err != nil {
+		return nil, err
 	}
 
+	sd := new(StreamDiscoverer)
+	sd.pile = pile
+	sd.discoverer = &Discoverer{C.grok_discover_new(&pile.p.library)}
+	sd.bufferSize = bufferSize
+	sd.learned = make(map[string]bool)
+	return sd, nil
+}
+
+/* Match str against the Pile. Lines nothing matches are buffered, and a
+   full buffer is turned into new Groks, which are added to the end of the
+   Pile. The line that filled the buffer is then tried again. */
+func (sd *StreamDiscoverer) Match(str string) (*Grok, *Match) {
+	if grok, match := sd.pile.Match(str); grok != nil {
+		return grok, match
+	}
+
+	sd.lock.Lock()
+	sd.unmatched = append(sd.unmatched, str)
+	full := len(sd.unmatched) >= sd.bufferSize
+	if full {
+		sd.learn()
+	}
+	sd.lock.Unlock()
+
+	if full {
+		return sd.pile.Match(str)
+	}
 	return nil, nil
 }
 
+/* Learn patterns from whatever is buffered now, returning the new ones. */
+func (sd *StreamDiscoverer) Learn() []string {
+	sd.lock.Lock()
+	defer sd.lock.Unlock()
+	return sd.learn()
+}
+
+/* Match every line read from r, calling fn with each line and its Grok and
+   Match, or nils if nothing matched even after learning. As with
+   Pile.Match, fn must Free the Match. */
+func (sd *StreamDiscoverer) Process(r io.Reader, fn func(line string, grok *Grok, match *Match)) error {
+	scanner := bufio.NewScanner(r)
+	scanner.Buffer(make([]byte, 64*1024), 1024*1024)
+	for scanner.Scan() {
+		line := scanner.Text()
+		grok, match := sd.Match(line)
+		fn(line, grok, match)
+	}
+	return scanner.Err()
+}
+
+/* Every pattern learned so far, in the order they were added to the Pile */
+func (sd *StreamDiscoverer) Learned() []string {
+	sd.lock.Lock()
+	defer sd.lock.Unlock()
+	return append([]string(nil), sd.patterns...)
+}
+
+func (sd *StreamDiscoverer) Free() {
+	sd.discoverer.Free()
+}
+
+/* Discover patterns for the buffered lines and compile them into the Pile.
+   The caller holds sd.lock. */
+func (sd *StreamDiscoverer) learn() []string {
+	if len(sd.unmatched) == 0 {
+		return nil
+	}
+
+	/* The discoverer shares the Pile's pattern library, which AddPattern
+	   and Compile change under the write lock */
+	sd.pile.lock.RLock()
+	results := sd.discoverer.DiscoverCorpus(sd.unmatched, 0)
+	sd.pile.lock.RUnlock()
+
+	var added []string
+	for _, result := range results {
+		pattern := "^" + result.Pattern + "$"
+		if result.Matched == 0 || sd.learned[pattern] {
+			continue
+		}
+		/* Without a grok reference, the pattern is just the line's own
+		   text, and would only ever match that one line again */
+		if !strings.Contains(result.Pattern, "%{") {
+			continue
+		}
+		sd.learned[pattern] = true
+		if err := sd.pile.Compile(pattern, false); err != nil {
+			continue
+		}
+		added = append(added, pattern)
+	}
+	sd.patterns = append(sd.patterns, added...)
+	sd.unmatched = sd.unmatched[:0]
+	return added
+}
+
 func (match *Match) Captures() map[string][]string {
 	captures := make(map[string][]string)
 
@@ -274,12 +1165,33 @@ func (match *Match) EndIterator() {
 	C.grok_match_walk_end(&match.gm)
 }
 
+/* Forget the last match so the Match can be passed to MatchInto again,
+   ending any iterator. Strings already returned from it stay valid. */
+func (match *Match) Reset() {
+	if match.gm.iter != nil {
+		C.grok_match_walk_end(&match.gm)
+	}
+	match.gm.start = 0
+	match.gm.end = 0
+	match.grok = nil
+	match.subject = ""
+	match.err = nil
+	match.gname = ""
+	match.gsubstring = ""
+	match.name = nil
+	match.namelen, match.suboffset, match.sublen = 0, 0, 0
+}
+
 func (match *Match) Free() {
 	ptr := unsafe.Pointer(match.gm.subject)
 	if uintptr(ptr) != 0 {
 		C.free(ptr)
 	}
 	C.grok_match_free(&match.gm)
+	match.gm.subject = nil
+	match.gm.pcre_capture_vector = nil
+	match.subjectSize = 0
+	match.vectorSize = 0
 }
 
 /* Returns an array of two integers, where the first is the starting index of the match, and
@@ -289,6 +1201,38 @@ func (match *Match) FindIndex() []int {
 	return []int{int(match.gm.start), int(match.gm.end)}
 }
 
+/* Convert a named capture to a decimal integer, without copying it out of
+   the subject. */
+func (match *Match) Int(name string) (int64, error) {
+	cname := C.CString(name)
+	defer C.free(unsafe.Pointer(cname))
+
+	var value C.long
+	switch C.grok_match_get_named_long(&match.gm, cname, &value) {
+	case 0:
+		return int64(value), nil
+	case -1:
+		return 0, errors.New(fmt.Sprintf("No capture named %s", name))
+	}
+	return 0, errors.New(fmt.Sprintf("Capture %s is not an integer", name))
+}
+
+/* Convert a named capture to a float, without copying it out of the
+   subject. */
+func (match *Match) Float(name string) (float64, error) {
+	cname := C.CString(name)
+	defer C.free(unsafe.Pointer(cname))
+
+	var value C.double
+	switch C.grok_match_get_named_double(&match.gm, cname, &value) {
+	case 0:
+		return float64(value), nil
+	case -1:
+		return 0, errors.New(fmt.Sprintf("No capture named %s", name))
+	}
+	return 0, errors.New(fmt.Sprintf("Capture %s is not a number", name))
+}
+
 func boolToInt(b bool) int {
 	if b {
 		return 1
@@ -43,7 +43,14 @@ struct grok {
   TCTREE *patterns;
 
   pcre *re;
+  pcre_extra *re_extra;
   int pcre_num_captures;
+
+  /** number of %{FOO} expansions made by grok_compile() */
+  int expansions;
+
+  /** deepest nesting of %{FOO} expansions seen by grok_compile() */
+  int max_expand_depth;
   
   /* Data storage for named-capture (grok capture) information */
   TCTREE *captures_by_id;
@@ -51,6 +58,10 @@ struct grok {
   TCTREE *captures_by_subname;
   TCTREE *captures_by_capture_number;
   int max_capture_num;
+
+  /** Copies of the captures with predicates, by callout number - 1 */
+  struct grok_capture *predicates;
+  int npredicates;
   
   /** PCRE pattern compilation errors */
   const char *pcre_errptr;
@@ -62,6 +73,47 @@ struct grok {
   char *errstr;
 };
 
+/* PCRE flags a caseless first/required byte with this bit (REQ_CASELESS) */
+#define PCRE_BYTE_CASELESS 0x0100
+
+/** Compile-time statistics, as reported by grok_compile_stats() */
+typedef struct grok_compile_stats {
+  /** length of the pattern given to grok_compile() */
+  int pattern_len;
+
+  /** length of the fully expanded pattern */
+  int full_pattern_len;
+
+  /** number of %{FOO} expansions performed */
+  int expansions;
+
+  /** deepest nesting of expansions; %{FOO} alone is depth 1 */
+  int max_depth;
+
+  /** PCRE capture groups, not counting the 0th group */
+  int capture_count;
+
+  /** size of the compiled regexp (PCRE_INFO_SIZE) */
+  size_t compiled_size;
+
+  /** size of the pcre_study() data (PCRE_INFO_STUDYSIZE), 0 if none */
+  size_t study_size;
+
+  /** fixed first byte of any match, or -1 (start of line) / -2 (unknown) */
+  int first_byte;
+  int first_byte_caseless;
+
+  /** byte that must appear in any match, or -1 if none */
+  int required_byte;
+  int required_byte_caseless;
+
+  /** 1 if pcre_study() found a set of possible starting bytes */
+  int has_start_bits;
+
+  /** 1 if the pattern can only match at the start of the subject */
+  int anchored;
+} grok_compile_stats_t;
+
 extern int g_grok_global_initialized;
 extern pcre *g_pattern_re;
 extern int g_pattern_num_captures;
@@ -140,7 +192,11 @@ extern int g_cap_definition;
 #endif
 
 #include "grok_match.h"
+#include "grok_number.h"
 #include "grok_discover.h"
+#include "grok_drain.h"
+#include "grok_pile.h"
+#include "grok_scan.h"
 #include "grok_version.h"
 
 /**
@@ -228,6 +284,27 @@ int grok_compile(grok_t *grok, const char *pattern, int renamed_only);
  */
 int grok_compilen(grok_t *grok, const char *pattern, int length, int renamed_only);
 
+/**
+ * Expand %{PATTERN}s into a plain regexp, for callers that only need to
+ * know whether text matches. Patterns become non-capturing groups, any
+ * predicates are dropped, and nothing is recorded in grok.
+ *
+ * @param expanded_len set to the length of the result.
+ * @returns the expanded regexp, which the caller must free(), or NULL if
+ *          expansion failed.
+ */
+char *grok_expand_match_only(grok_t *grok, const char *pattern, int length,
+                             int *expanded_len);
+
+/**
+ * Report size and complexity statistics about the last compiled pattern.
+ *
+ * @param grok a grok_t instance that has been through grok_compile()
+ * @param stats the grok_compile_stats_t to fill in.
+ * @returns GROK_OK, or GROK_ERROR_UNINITIALIZED if nothing is compiled.
+ */
+int grok_compile_stats(const grok_t *grok, grok_compile_stats_t *stats);
+
 /**
  * Execute against a string input.
  *
@@ -242,6 +319,18 @@ int grok_exec(const grok_t *grok, const char *text, grok_match_t *gm);
  * */
 int grok_execn(const grok_t *grok, const char *text, int textlen, grok_match_t *gm);
 
+/**
+ * Execute against a string input, storing the PCRE capture vector in the
+ * caller's buffer instead of a grok_match_t. Nothing refers to text or
+ * vector once this returns.
+ *
+ * @param vector the capture vector; vector_size should be
+ *        grok->pcre_num_captures * 3 to see every capture.
+ * @returns GROK_OK if match successful, GROK_ERROR_NOMATCH if no match.
+ */
+int grok_execn_vector(const grok_t *grok, const char *text, int textlen,
+                      int *vector, int vector_size);
+
 int grok_match_get_named_substring(const grok_match_t *gm, const char *name,
                                    const char **substr, int *len);
 
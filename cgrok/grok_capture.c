@@ -61,8 +61,7 @@ void grok_capture_init(grok_t *grok, grok_capture *gct) {
   gct->subname_len = 0;
   gct->pattern = NULL;
   gct->pattern_len = 0;
-  gct->predicate_lib = NULL;
-  gct->predicate_func_name = NULL;
+  gct->predicate_func = NULL;
   gct->extra.extra_len = 0;
   gct->extra.extra_val = NULL;
 }
@@ -210,8 +209,6 @@ void grok_capture_free(grok_capture *gct) {
   _GCT_STRFREE(gct, name);
   _GCT_STRFREE(gct, subname);
   _GCT_STRFREE(gct, pattern);
-  _GCT_STRFREE(gct, predicate_lib);
-  _GCT_STRFREE(gct, predicate_func_name);
   _GCT_STRFREE(gct, extra.extra_val);
 }
 
@@ -242,3 +239,27 @@ int grok_capture_walk_end(grok_t *grok) {
   /* nothing, anymore */
   return 0;
 }
+
+int grok_capture_callout(pcre_callout_block *block) {
+  const grok_t *grok = block->callout_data;
+  const grok_capture *gct;
+  int start, end;
+
+  /* Not one of ours, or a predicate that failed to compile */
+  if (grok == NULL || block->callout_number < 1
+      || block->callout_number > grok->npredicates) {
+    return 0;
+  }
+  gct = grok->predicates + block->callout_number - 1;
+  if (gct->predicate_func == NULL || gct->pcre_capture_number < 0
+      || gct->pcre_capture_number >= block->capture_top) {
+    return 0;
+  }
+
+  start = block->offset_vector[gct->pcre_capture_number * 2];
+  end = block->offset_vector[gct->pcre_capture_number * 2 + 1];
+  if (start < 0) {
+    return 0;
+  }
+  return gct->predicate_func((grok_t *)grok, gct, block->subject, start, end);
+}
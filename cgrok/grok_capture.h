@@ -3,6 +3,17 @@
 
 #include "grok.h"
 
+struct grok_capture;
+
+/**
+ * A predicate on a capture, like %{NUMBER:x > 100}. Called from the PCRE
+ * callout once the capture has matched subject[start, end); returns 0 to
+ * accept it, or 1 to make PCRE backtrack and try another match.
+ */
+typedef int (*grok_predicate_func)(grok_t *grok,
+                                   const struct grok_capture *gct,
+                                   const char *subject, int start, int end);
+
 struct grok_capture {
 	int name_len;
 	char *name;
@@ -12,10 +23,7 @@ struct grok_capture {
 	char *pattern;
 	int id;
 	int pcre_capture_number;
-	int predicate_lib_len;
-	char *predicate_lib;
-	int predicate_func_name_len;
-	char *predicate_func_name;
+	grok_predicate_func predicate_func;
 	struct {
 		uint32_t extra_len;
 		char *extra_val;
@@ -38,6 +46,12 @@ TCTREE_ITER *grok_capture_walk_init(const grok_t *grok);
 const grok_capture *grok_capture_walk_next(const TCTREE_ITER *iter, const grok_t *grok);
 
 int grok_capture_set_extra(grok_t *grok, grok_capture *gct, void *extra);
+
+/**
+ * pcre_callout handler, installed by grok_init(). The callout number of a
+ * (?Cn) that grok inserted after a capture selects grok->predicates[n - 1].
+ */
+int grok_capture_callout(pcre_callout_block *block);
 void _grok_capture_encode(grok_capture *gct, char **data_ret, int *size_ret);
 void _grok_capture_decode(grok_capture *gct, char *data, int size);
 
@@ -0,0 +1,140 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "grok_cidr.h"
+#include "grok_number.h"
+
+/* The first len bits set */
+#define CIDR_MASK(len) ((len) == 0 ? 0 : 0xffffffffu << (32 - (len)))
+/* Bit number pos of addr, counting from the most significant */
+#define CIDR_BIT(addr, pos) (((addr) >> (31 - (pos))) & 1)
+
+static int cidr_node_new(grok_cidr_tree_t *tree, uint32_t prefix, int len,
+                         int terminal) {
+  grok_cidr_node_t *node;
+  if (tree->nnodes == tree->nodes_size) {
+    tree->nodes_size = (tree->nodes_size == 0) ? 16 : tree->nodes_size * 2;
+    tree->nodes = realloc(tree->nodes,
+                          tree->nodes_size * sizeof(grok_cidr_node_t));
+  }
+  node = tree->nodes + tree->nnodes;
+  node->prefix = prefix & CIDR_MASK(len);
+  node->len = len;
+  node->terminal = terminal;
+  node->child[0] = node->child[1] = 0;
+  return tree->nnodes++;
+}
+
+/* Length of the common prefix of a and b, at most max bits */
+static int cidr_common(uint32_t a, uint32_t b, int max) {
+  uint32_t diff = a ^ b;
+  int common = (diff == 0) ? 32 : __builtin_clz(diff);
+  return (common < max) ? common : max;
+}
+
+void grok_cidr_tree_init(grok_cidr_tree_t *tree) {
+  tree->nodes = NULL;
+  tree->nnodes = 0;
+  tree->nodes_size = 0;
+  cidr_node_new(tree, 0, 0, 0);
+}
+
+void grok_cidr_tree_clean(grok_cidr_tree_t *tree) {
+  free(tree->nodes);
+  tree->nodes = NULL;
+  tree->nnodes = tree->nodes_size = 0;
+}
+
+void grok_cidr_tree_add(grok_cidr_tree_t *tree, uint32_t prefix, int len) {
+  int n = 0;
+
+  prefix &= CIDR_MASK(len);
+  /* Invariant: node n's prefix is a prefix of the new range */
+  for (;;) {
+    grok_cidr_node_t *node = tree->nodes + n;
+    int bit, c, common, split;
+    uint32_t child_prefix;
+    int child_len;
+
+    if (node->len == len) {
+      node->terminal = 1;
+      return;
+    }
+    if (node->terminal) {
+      return; /* already covered by a shorter range */
+    }
+
+    bit = CIDR_BIT(prefix, node->len);
+    c = node->child[bit];
+    if (c == 0) {
+      c = cidr_node_new(tree, prefix, len, 1);
+      tree->nodes[n].child[bit] = c;
+      return;
+    }
+
+    child_prefix = tree->nodes[c].prefix;
+    child_len = tree->nodes[c].len;
+    common = cidr_common(prefix, child_prefix,
+                         (len < child_len) ? len : child_len);
+    if (common == child_len) {
+      n = c;
+      continue;
+    }
+
+    /* The new range and the child diverge, or the new range contains the
+     * child: put a node for their common prefix between n and the child */
+    split = cidr_node_new(tree, prefix, common, common == len);
+    tree->nodes[split].child[CIDR_BIT(child_prefix, common)] = c;
+    if (common < len) {
+      int leaf = cidr_node_new(tree, prefix, len, 1);
+      tree->nodes[split].child[CIDR_BIT(prefix, common)] = leaf;
+    }
+    tree->nodes[n].child[bit] = split;
+    return;
+  }
+}
+
+int grok_cidr_tree_add_text(grok_cidr_tree_t *tree, const char *text,
+                            int textlen) {
+  uint32_t addr;
+  long len = 32;
+  int pos;
+
+  pos = grok_parse_ipv4(text, textlen, &addr);
+  if (pos == 0) {
+    return -1;
+  }
+  if (pos < textlen) {
+    if (text[pos] != '/' || pos + 1 == textlen
+        || text[pos + 1] < '0' || text[pos + 1] > '9'
+        || grok_parse_long(text + pos + 1, textlen - pos - 1, 10, &len)
+           != textlen - pos - 1
+        || len > 32) {
+      return -1;
+    }
+  }
+
+  grok_cidr_tree_add(tree, addr, len);
+  return 0;
+}
+
+int grok_cidr_tree_contains(const grok_cidr_tree_t *tree, uint32_t addr) {
+  const grok_cidr_node_t *node = tree->nodes;
+  for (;;) {
+    int c;
+    if ((addr ^ node->prefix) & CIDR_MASK(node->len)) {
+      return 0;
+    }
+    if (node->terminal) {
+      return 1;
+    }
+    if (node->len == 32) {
+      return 0;
+    }
+    c = node->child[CIDR_BIT(addr, node->len)];
+    if (c == 0) {
+      return 0;
+    }
+    node = tree->nodes + c;
+  }
+}
@@ -0,0 +1,53 @@
+/**
+ * @file grok_cidr.h
+ */
+#ifndef _GROK_CIDR_H_
+#define _GROK_CIDR_H_
+#include <stdint.h>
+
+/**
+ * A node of a grok_cidr_tree_t: the first len bits of prefix, and the
+ * subtrees for addresses whose next bit is 0 or 1.
+ */
+typedef struct grok_cidr_node {
+  uint32_t prefix;
+  unsigned char len;
+  /** set if prefix/len is one of the tree's ranges */
+  unsigned char terminal;
+  /** node indexes, or 0 for none; the root is never anyone's child */
+  int child[2];
+} grok_cidr_node_t;
+
+/**
+ * A set of IPv4 ranges in a path-compressed binary trie (a Patricia
+ * tree). A lookup follows at most one node per distinct prefix length on
+ * the address's path, and stops at the first range containing it.
+ */
+typedef struct grok_cidr_tree {
+  grok_cidr_node_t *nodes;
+  int nnodes;
+  int nodes_size;
+} grok_cidr_tree_t;
+
+void grok_cidr_tree_init(grok_cidr_tree_t *tree);
+void grok_cidr_tree_clean(grok_cidr_tree_t *tree);
+
+/**
+ * Add the range of addresses whose first len bits match prefix's.
+ */
+void grok_cidr_tree_add(grok_cidr_tree_t *tree, uint32_t prefix, int len);
+
+/**
+ * Parse "a.b.c.d/len", or "a.b.c.d" for a single address, and add it.
+ *
+ * @returns 0, or -1 if text isn't a valid range.
+ */
+int grok_cidr_tree_add_text(grok_cidr_tree_t *tree, const char *text,
+                            int textlen);
+
+/**
+ * @returns 1 if addr is in any of the tree's ranges, 0 otherwise.
+ */
+int grok_cidr_tree_contains(const grok_cidr_tree_t *tree, uint32_t addr);
+
+#endif /* _GROK_CIDR_H_ */
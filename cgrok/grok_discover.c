@@ -1,13 +1,22 @@
 #include "grok.h"
 #include "stringhelper.h"
 
-static int dgrok_init = 0;
+#include <pthread.h>
+#include <unistd.h>
+
+static pthread_once_t dgrok_init = PTHREAD_ONCE_INIT;
 static grok_t global_discovery_req1_grok;
 static grok_t global_discovery_req2_grok;
 static int complexity(const grok_t *grok);
 
+/* A pattern's grok and its place in the library, for sorting */
+typedef struct discover_candidate {
+  grok_t grok;
+  int complexity;
+  int index;
+} discover_candidate_t;
+
 static void grok_discover_global_init() {
-  dgrok_init = 1;
   grok_init(&global_discovery_req1_grok);
   grok_compile(&global_discovery_req1_grok, ".\\b.", false);
 
@@ -21,21 +30,33 @@ grok_discover_t *grok_discover_new(grok_t *source_grok) {
   return gdt;
 }
 
+/* Most complex first. Among equals, later patterns go first. */
+static int candidate_cmp(const void *a, const void *b) {
+  const discover_candidate_t *ca = a, *cb = b;
+  if (ca->complexity != cb->complexity) {
+    return (ca->complexity < cb->complexity) ? -1 : 1;
+  }
+  return cb->index - ca->index;
+}
+
 void grok_discover_init(grok_discover_t *gdt, grok_t *source_grok) {
   TCLIST *names = NULL;
+  discover_candidate_t *candidates;
+  int ncandidates = 0;
   int i = 0, len = 0;
 
-  if (dgrok_init == 0) {
-    grok_discover_global_init();
-  }
+  pthread_once(&dgrok_init, grok_discover_global_init);
 
-  gdt->complexity_tree = tctreenew2(tccmpint32, NULL);
+  gdt->groks = NULL;
+  gdt->complexities = NULL;
+  gdt->ngroks = 0;
   gdt->base_grok = source_grok;
   gdt->logmask = source_grok->logmask;
   gdt->logdepth = source_grok->logdepth;
 
   names = grok_pattern_name_list(source_grok);
   len = tclistnum(names);
+  candidates = malloc(len * sizeof(discover_candidate_t));
   /* for each pattern, create a grok. 
    * Sort by complexity.
    * loop
@@ -46,8 +67,8 @@ void grok_discover_init(grok_discover_t *gdt, grok_t *source_grok) {
     int namelen = 0;
     const char *name = tclistval(names, i, &namelen);
 
-    int *key = malloc(sizeof(int));
-    grok_t *g = grok_new();
+    int key;
+    grok_t *g = &candidates[ncandidates].grok;
     grok_clone(g, source_grok);
     char *gpattern;
     //if (asprintf(&gpattern, "%%{%.*s =~ /\\b/}", namelen, name) == -1) {
@@ -55,34 +76,51 @@ void grok_discover_init(grok_discover_t *gdt, grok_t *source_grok) {
       perror("asprintf failed");
       abort();
     }
-    grok_compile(g, gpattern, false);
-    *key = complexity(g);
+    if (grok_compile(g, gpattern, false) != GROK_OK) {
+      free(gpattern);
+      grok_free_clone(g);
+      continue;
+    }
+    key = complexity(g);
 
     /* Low complexity should be skipped */
-    if (*key > -20) {
-      free((void *)g->pattern);
-      free(key);
+    if (key > -20) {
+      free(gpattern);
       grok_free_clone(g);
-      free(g);
       continue;
     }
 
-    *key *= 1000; /* Inflate so we can insert duplicates */
     grok_log(gdt, LOG_DISCOVER, "Including pattern: (complexity: %d) %.*s",
-             *(int *)key, namelen, name);
-    while (!tctreeputkeep(gdt->complexity_tree, key, sizeof(int), 
-                          g, sizeof(grok_t))) {
-      *key -= 1;
-    }
-    //grok_free_clone(g);
-    //free(key);
+             key, namelen, name);
+    candidates[ncandidates].complexity = key;
+    candidates[ncandidates].index = i;
+    ncandidates++;
   }
 
   tclistdel(names);
+
+  qsort(candidates, ncandidates, sizeof(discover_candidate_t), candidate_cmp);
+  gdt->groks = malloc(ncandidates * sizeof(grok_t));
+  gdt->complexities = malloc(ncandidates * sizeof(int));
+  for (i = 0; i < ncandidates; i++) {
+    gdt->groks[i] = candidates[i].grok;
+    gdt->complexities[i] = candidates[i].complexity;
+  }
+  gdt->ngroks = ncandidates;
+  free(candidates);
 }
 
 void grok_discover_clean(grok_discover_t *gdt) {
-  tctreedel(gdt->complexity_tree);
+  int i;
+  for (i = 0; i < gdt->ngroks; i++) {
+    free((void *)gdt->groks[i].pattern);
+    grok_free_clone(&gdt->groks[i]);
+  }
+  free(gdt->groks);
+  free(gdt->complexities);
+  gdt->groks = NULL;
+  gdt->complexities = NULL;
+  gdt->ngroks = 0;
   gdt->base_grok = NULL;
 }
 
@@ -91,134 +129,206 @@ void grok_discover_free(grok_discover_t *gdt) {
   free(gdt);
 }
 
+/* Run g over text from offset, like grok_execn() but letting lookbehinds
+ * see what's before offset. Only the bounds of the match are kept, but
+ * predicates need the whole capture vector to see their captures. */
+static int discover_exec(const grok_t *g, const char *text, int textlen,
+                         int offset, int *start, int *end) {
+  int vector_size = (g->npredicates > 0) ? g->pcre_num_captures * 3 : 3;
+  int *ovector;
+  pcre_extra pce;
+  int ret;
+
+  if (g->re_extra != NULL) {
+    pce = *g->re_extra;
+  } else {
+    pce.flags = 0;
+  }
+  pce.flags |= PCRE_EXTRA_CALLOUT_DATA;
+  pce.callout_data = (void *)g;
+
+  ovector = calloc(vector_size, sizeof(int));
+  ret = pcre_exec(g->re, &pce, text, textlen, offset, 0, ovector, vector_size);
+  if (ret < 0) {
+    free(ovector);
+    return GROK_ERROR_NOMATCH;
+  }
+  *start = ovector[0];
+  *end = ovector[1];
+  free(ovector);
+  return GROK_OK;
+}
+
+/* A span of the input some pattern matched */
+typedef struct discover_span {
+  int start;
+  int end;
+  int grok;
+  /* best total weight of spans ending at or before this one's end, and
+   * whether that includes this span */
+  int64_t best;
+  int taken;
+} discover_span_t;
+
+static int span_end_cmp(const void *a, const void *b) {
+  const discover_span_t *sa = a, *sb = b;
+  if (sa->end != sb->end) {
+    return sa->end - sb->end;
+  }
+  return sa->start - sb->start;
+}
+
+/* Append literal text to pattern, quoted with \Q..\E. A \E in the text
+ * would end the quoting early, so it's written as \E\\E\Q. */
+static void discover_append_literal(char **pattern, int *pattern_len,
+                                    int *pattern_size, const char *text,
+                                    int len) {
+  const char *end = text + len;
+  substr_replace(pattern, pattern_len, pattern_size, *pattern_len,
+                 *pattern_len, "\\Q", 2);
+  while (text < end) {
+    const char *quote_end = text;
+    while (quote_end + 1 < end && !(quote_end[0] == '\\' && quote_end[1] == 'E')) {
+      quote_end++;
+    }
+    if (quote_end + 1 >= end) {
+      quote_end = end;
+    }
+    substr_replace(pattern, pattern_len, pattern_size, *pattern_len,
+                   *pattern_len, text, quote_end - text);
+    if (quote_end == end) {
+      break;
+    }
+    substr_replace(pattern, pattern_len, pattern_size, *pattern_len,
+                   *pattern_len, "\\E\\\\E\\Q", 7);
+    text = quote_end + 2;
+  }
+  substr_replace(pattern, pattern_len, pattern_size, *pattern_len,
+                 *pattern_len, "\\E", 2);
+}
+
 void grok_discover(const grok_discover_t *gdt, /*grok_t *dest_grok, */
                    const char *input, char **discovery, int *discovery_len) {
-  /* Find known patterns in the input string */
+  /* Find known patterns in the input string.
+   *
+   * Each pattern is run once across the whole input, restarting after
+   * each match, to collect every span it matches. Then weighted interval
+   * scheduling picks the set of non-overlapping spans that covers the most
+   * input; among equal coverage it prefers fewer and less complex
+   * patterns. */
   char *pattern = NULL;
   int pattern_len = 0;
   int pattern_size = 0;
+  int input_len = strlen(input);
+
+  discover_span_t *spans = NULL;
+  int nspans = 0;
+  int spans_size = 0;
+  int i, j;
+  int *chosen;
+  int nchosen = 0;
+  int cursor;
+
+  for (i = 0; i < gdt->ngroks; i++) {
+    const grok_t *g = gdt->groks + i;
+    int offset = 0;
+    int start, end;
+
+    while (offset <= input_len
+           && discover_exec(g, input, input_len, offset, &start, &end) == GROK_OK) {
+      int matchlen = end - start;
+      offset = (end > start) ? end : start + 1;
+
+      grok_log(gdt, LOG_DISCOVER, "%s matched '%.*s' at %d",
+               g->pattern, matchlen, input + start, start);
+
+      if (grok_execn(&global_discovery_req1_grok, input + start, matchlen,
+                     NULL) != GROK_OK) {
+        grok_log(gdt, LOG_DISCOVER, "Match (%.*s) not complex enough.",
+                 matchlen, input + start);
+        continue;
+      }
 
-  int replacements = -1;
-  int offset = 0; /* Track what start position we are in the string */
-  int rounds = 0;
-
-  /* This uses substr_replace to copy the input string while allocating
-   * the size properly and tracking the length */
-  substr_replace(&pattern, &pattern_len, &pattern_size, 0, 0, input, -1);
-
-  while (replacements != 0 || offset < pattern_len) {
-    const void *key;
-    int key_len;
-    int match = 0;
-    grok_match_t gm;
-    grok_match_t best_match;
-    TCTREE_ITER *tree_iter; 
-
-    grok_log(gdt, LOG_DISCOVER, "%d: Round starting", rounds);
-    grok_log(gdt, LOG_DISCOVER, "%d: String: %.*s", rounds, pattern_len, pattern);
-    grok_log(gdt, LOG_DISCOVER, "%d: Offset: % *s^", rounds, offset - 1, " ");
-
-    tree_iter = tctreeiterinit(gdt->complexity_tree);
-    rounds++;
-
-    replacements = 0;
-    /* This is used for tracking the longest matched pattern */
-    int max_matchlen = 0; 
-
-    /* This is used for finding the earliest (leftwise in the string) match
-     * end point. If no matches are found, we'll skip to this position in the
-     * string to find more things to match
-     */
-    int first_match_endpos = -1; 
-
-    char *cursor = pattern + offset;
-
-    while ((key = tctreeiternext(tree_iter, &key_len)) != NULL) {
-      const int *complexity = (const int *)key;
-      int val_len;
-      const grok_t *g = tctreeget(gdt->complexity_tree, key, sizeof(int), &val_len);
-      match = grok_exec(g, cursor, &gm);
-      grok_log(gdt, LOG_DISCOVER, "Test %s against %.*s",
-               (match == GROK_OK ? "succeeded" : "failed"), g->pattern_len, g->pattern);
-
-      if (match == GROK_OK) {
-        int still_ok;
-        int matchlen = gm.end - gm.start;
-        grok_log(gdt, LOG_DISCOVER, "Matched %.*s", matchlen , cursor + gm.start);
-
-        if (first_match_endpos == -1 || gm.end < first_match_endpos) {
-          first_match_endpos = gm.end;
-        }
-
-        still_ok = grok_execn(&global_discovery_req1_grok, cursor + gm.start,
-                              matchlen, NULL);
-        if (still_ok != GROK_OK) {
-          grok_log(gdt, LOG_DISCOVER, 
-                   "%d: Matched %s, but match (%.*s) not complex enough.",
-                   rounds, g->pattern, matchlen, cursor + gm.start);
-          continue;
-        }
-
-        /* We don't want to replace existing patterns like %{FOO} */
-        if (grok_execn(&global_discovery_req2_grok, cursor + gm.start, matchlen,
-                       NULL) == GROK_OK) {
-          grok_log(gdt, LOG_DISCOVER, 
-                   "%d: Matched %s, but match (%.*s) includes %{...} patterns.",
-                   rounds, g->pattern, matchlen, cursor + gm.start);
-          continue;
-        }
-
-        /* A longer match is a better match.
-         * If match length is equal to max, then still take this match as
-         * better since if true, then this match has a pattern that is less
-         * complex and is therefore a more relevant match */
-        if (max_matchlen <= matchlen) {
-          grok_log(gdt, LOG_DISCOVER,
-                   "%d: New best match: %s", rounds, g->pattern);
-          max_matchlen = matchlen;
-          memcpy(&best_match, &gm, sizeof(grok_match_t));
-        } else if (max_matchlen == matchlen) {
-          /* Found a match with same length */
-          grok_log(gdt, LOG_DISCOVER, "%d: Common length match: %s", rounds, g->pattern);
-        }
-      } /* match == GROK_OK */
-    } /* tctreeiternext(complexity_tree ...) */
-
-    tctreeiterfree(tree_iter);
-
-    if (max_matchlen == 0) { /* No valid matches were found */
-      if (first_match_endpos > 0) {
-        offset += first_match_endpos;
+      /* We don't want to replace existing patterns like %{FOO} */
+      if (grok_execn(&global_discovery_req2_grok, input + start, matchlen,
+                     NULL) == GROK_OK) {
+        grok_log(gdt, LOG_DISCOVER, "Match (%.*s) includes %{...} patterns.",
+                 matchlen, input + start);
+        continue;
+      }
+
+      if (nspans == spans_size) {
+        spans_size = (spans_size == 0) ? 64 : spans_size * 2;
+        spans = realloc(spans, spans_size * sizeof(discover_span_t));
+      }
+      spans[nspans].start = start;
+      spans[nspans].end = end;
+      spans[nspans].grok = i;
+      nspans++;
+    }
+  }
+
+  /* Weighted interval scheduling over spans sorted by end. A span's weight
+   * is its length, scaled so that it always dominates, plus its pattern's
+   * (negative) complexity. */
+  qsort(spans, nspans, sizeof(discover_span_t), span_end_cmp);
+  for (j = 0; j < nspans; j++) {
+    int64_t weight = (int64_t)(spans[j].end - spans[j].start) * 1000000
+                     + gdt->complexities[spans[j].grok];
+    int64_t without = (j > 0) ? spans[j - 1].best : 0;
+    int64_t with = weight;
+    int lo = 0, hi = j;
+
+    /* the last span ending at or before this one starts */
+    while (lo < hi) {
+      int mid = (lo + hi) / 2;
+      if (spans[mid].end <= spans[j].start) {
+        lo = mid + 1;
       } else {
-        offset += 1;
+        hi = mid;
       }
-    } else { /* We found a match, replace it in the pattern */
-      grok_log(gdt, LOG_DISCOVER, "%d: Matched %s on '%.*s'",
-               rounds, best_match.grok->pattern,
-               best_match.end - best_match.start, cursor + best_match.start);
-      replacements = 1;
-      substr_replace(&pattern, &pattern_len, &pattern_size,
-                     best_match.start + offset, best_match.end + offset,
-                     best_match.grok->pattern, best_match.grok->pattern_len);
-      substr_replace(&pattern, &pattern_len, &pattern_size,
-                     best_match.start + offset, best_match.start + offset, "\\E", 2);
-      substr_replace(&pattern, &pattern_len, &pattern_size,
-                     best_match.start + best_match.grok->pattern_len + 2 + offset,
-                     0, "\\Q", 2);
-      //usleep(1000000);
-
-      /* Wrap the new regexp in \E .. \Q, for ending and beginning (respectively)
-       * 'quote literal' as PCRE and Perl support. This prevents literal characters
-       * in the input strings from being interpreted */
-      grok_log(gdt, LOG_DISCOVER, "%d: Pattern: %.*s", rounds, pattern_len, pattern);
-    } /* if (max_matchlen != 0) */
-  } /* while (replacements != 0) */
-
-  /* Add \Q and \E at beginning and end */
-  substr_replace(&pattern, &pattern_len, &pattern_size,
-                 0, 0, "\\Q", 2);
-  substr_replace(&pattern, &pattern_len, &pattern_size,
-                 pattern_len, pattern_len, "\\E", 2);
+    }
+    if (lo > 0) {
+      with += spans[lo - 1].best;
+    }
+
+    spans[j].taken = (with > without);
+    spans[j].best = spans[j].taken ? with : without;
+  }
+
+  /* Walk back through the choices */
+  chosen = malloc(nspans * sizeof(int) + 1);
+  j = nspans - 1;
+  while (j >= 0) {
+    if (!spans[j].taken) {
+      j--;
+      continue;
+    }
+    chosen[nchosen++] = j;
+    for (i = j - 1; i >= 0 && spans[i].end > spans[j].start; i--) {
+      /* skip spans overlapping this one */
+    }
+    j = i;
+  }
+
+  cursor = 0;
+  for (i = nchosen - 1; i >= 0; i--) {
+    const discover_span_t *span = spans + chosen[i];
+    const grok_t *g = gdt->groks + span->grok;
+    grok_log(gdt, LOG_DISCOVER, "Matched %s on '%.*s'", g->pattern,
+             span->end - span->start, input + span->start);
+    discover_append_literal(&pattern, &pattern_len, &pattern_size,
+                            input + cursor, span->start - cursor);
+    substr_replace(&pattern, &pattern_len, &pattern_size, pattern_len,
+                   pattern_len, g->pattern, g->pattern_len);
+    cursor = span->end;
+  }
+  discover_append_literal(&pattern, &pattern_len, &pattern_size,
+                          input + cursor, input_len - cursor);
+  grok_log(gdt, LOG_DISCOVER, "Pattern: %.*s", pattern_len, pattern);
+
+  free(chosen);
+  free(spans);
 
   /* TODO(sissel): Prune any useless \Q\E */
   *discovery = pattern;
@@ -227,8 +337,216 @@ void grok_discover(const grok_discover_t *gdt, /*grok_t *dest_grok, */
 
 /* Compute the relative complexity of a pattern */
 static int complexity(const grok_t *grok) {
-  int score;
+  int score = 0;
   score += string_count(grok->full_pattern, "|");
   score += strlen(grok->full_pattern) / 2;
   return -score; /* Sort most-complex first */
 }
+
+/* A line's shape, for clustering */
+typedef struct corpus_line {
+  uint64_t shape;
+  int index;
+} corpus_line_t;
+
+static int corpus_line_cmp(const void *a, const void *b) {
+  const corpus_line_t *la = a, *lb = b;
+  if (la->shape != lb->shape) {
+    return (la->shape < lb->shape) ? -1 : 1;
+  }
+  return la->index - lb->index;
+}
+
+/* Clusters are runs of lines with the same shape, shapes[start .. end) */
+typedef struct corpus_job {
+  const grok_discover_t *gdt;
+  const char * const *lines;
+  const int *line_lens;
+  const corpus_line_t *shapes;
+  const int *cluster_start;
+  int nclusters;
+  grok_discover_result_t *results;
+
+  /* next cluster to hand out */
+  int next;
+} corpus_job_t;
+
+static void corpus_discover_cluster(corpus_job_t *job, int cluster) {
+  const grok_discover_t *gdt = job->gdt;
+  int start = job->cluster_start[cluster];
+  int end = job->cluster_start[cluster + 1];
+  int rep = job->shapes[start].index;
+  grok_discover_result_t *result = job->results + cluster;
+  char *text, *anchored;
+  int anchored_len;
+  grok_t grok;
+  int i;
+
+  text = string_ndup(job->lines[rep], job->line_lens[rep]);
+  grok_discover(gdt, text, &result->pattern, &result->pattern_len);
+  free(text);
+
+  result->lines = end - start;
+  result->matched = 0;
+  result->representative = rep;
+
+  anchored_len = result->pattern_len + 2;
+  anchored = malloc(anchored_len + 1);
+  anchored[0] = '^';
+  memcpy(anchored + 1, result->pattern, result->pattern_len);
+  anchored[anchored_len - 1] = '$';
+  anchored[anchored_len] = '\0';
+
+  grok_clone(&grok, gdt->base_grok);
+  if (grok_compilen(&grok, anchored, anchored_len, false) != GROK_OK) {
+    grok_log(gdt, LOG_DISCOVER, "Discovered pattern failed to compile: %s",
+             anchored);
+  } else {
+    for (i = start; i < end; i++) {
+      int line = job->shapes[i].index;
+      if (grok_execn(&grok, job->lines[line], job->line_lens[line],
+                     NULL) == GROK_OK) {
+        result->matched++;
+      }
+    }
+  }
+  grok_free_clone(&grok);
+  free(anchored);
+
+  grok_log(gdt, LOG_DISCOVER, "Cluster of %d lines: %d matched %.*s",
+           result->lines, result->matched, result->pattern_len,
+           result->pattern);
+}
+
+static void *corpus_worker(void *arg) {
+  corpus_job_t *job = arg;
+  int cluster;
+  while ((cluster = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED))
+         < job->nclusters) {
+    corpus_discover_cluster(job, cluster);
+  }
+  return NULL;
+}
+
+/* Most matched lines first, then biggest clusters, then earliest */
+static int result_cmp(const void *a, const void *b) {
+  const grok_discover_result_t *ra = a, *rb = b;
+  if (ra->matched != rb->matched) {
+    return rb->matched - ra->matched;
+  }
+  if (ra->lines != rb->lines) {
+    return rb->lines - ra->lines;
+  }
+  return ra->representative - rb->representative;
+}
+
+int grok_discover_corpus(const grok_discover_t *gdt, const char * const *lines,
+                         const int *line_lens, int nlines, int nthreads,
+                         grok_discover_result_t **results) {
+  corpus_line_t *shapes;
+  int *cluster_start;
+  corpus_job_t job;
+  pthread_t *threads;
+  TCTREE *by_pattern;
+  int nresults = 0;
+  int started;
+  int i;
+
+  shapes = malloc((nlines + 1) * sizeof(corpus_line_t));
+  for (i = 0; i < nlines; i++) {
+    shapes[i].shape = grok_shape_fingerprint(lines[i], line_lens[i]);
+    shapes[i].index = i;
+  }
+  qsort(shapes, nlines, sizeof(corpus_line_t), corpus_line_cmp);
+
+  cluster_start = malloc((nlines + 1) * sizeof(int));
+  job.nclusters = 0;
+  for (i = 0; i < nlines; i++) {
+    if (i == 0 || shapes[i].shape != shapes[i - 1].shape) {
+      cluster_start[job.nclusters++] = i;
+    }
+  }
+  cluster_start[job.nclusters] = nlines;
+  grok_log(gdt, LOG_DISCOVER, "%d lines in %d clusters", nlines,
+           job.nclusters);
+
+  job.gdt = gdt;
+  job.lines = lines;
+  job.line_lens = line_lens;
+  job.shapes = shapes;
+  job.cluster_start = cluster_start;
+  job.results = calloc(job.nclusters + 1, sizeof(grok_discover_result_t));
+  job.next = 0;
+
+  if (nthreads <= 0) {
+#ifdef _SC_NPROCESSORS_ONLN
+    nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+#else
+    nthreads = 1;
+#endif
+  }
+  if (nthreads > job.nclusters) {
+    nthreads = job.nclusters;
+  }
+  if (nthreads <= 1) {
+    corpus_worker(&job);
+  } else {
+    threads = malloc(nthreads * sizeof(pthread_t));
+    for (started = 0; started < nthreads; started++) {
+      if (pthread_create(&threads[started], NULL, corpus_worker, &job) != 0) {
+        break;
+      }
+    }
+    if (started < nthreads) {
+      /* Workers claim clusters until there are none left, so one more
+       * here picks up whatever the missing threads would have done */
+      grok_log(gdt, LOG_DISCOVER, "Started %d of %d threads, working inline",
+               started, nthreads);
+      corpus_worker(&job);
+    }
+    for (i = 0; i < started; i++) {
+      pthread_join(threads[i], NULL);
+    }
+    free(threads);
+  }
+
+  /* Merge clusters that came up with the same pattern, compacting
+   * job.results in place */
+  by_pattern = tctreenew();
+  for (i = 0; i < job.nclusters; i++) {
+    grok_discover_result_t *result = job.results + i;
+    int size;
+    const int *existing = tctreeget(by_pattern, result->pattern,
+                                    result->pattern_len, &size);
+    if (existing == NULL) {
+      job.results[nresults] = *result;
+      tctreeput(by_pattern, result->pattern, result->pattern_len,
+                &nresults, sizeof(int));
+      nresults++;
+    } else {
+      grok_discover_result_t *merged = job.results + *existing;
+      merged->lines += result->lines;
+      merged->matched += result->matched;
+      if (result->representative < merged->representative) {
+        merged->representative = result->representative;
+      }
+      free(result->pattern);
+    }
+  }
+  tctreedel(by_pattern);
+
+  qsort(job.results, nresults, sizeof(grok_discover_result_t), result_cmp);
+
+  free(shapes);
+  free(cluster_start);
+  *results = job.results;
+  return nresults;
+}
+
+void grok_discover_results_free(grok_discover_result_t *results, int nresults) {
+  int i;
+  for (i = 0; i < nresults; i++) {
+    free(results[i].pattern);
+  }
+  free(results);
+}
@@ -5,8 +5,18 @@
 #define _GROK_DISCOVER_H_
 #include "grok.h"
 
+/**
+ * Finds known patterns in text. Initializing one compiles every pattern in
+ * the source grok's library; after that it's only read, so one
+ * grok_discover_t can be shared by any number of threads running
+ * grok_discover() at once. The source grok must outlive it.
+ */
 typedef struct grok_discover {
-  TCTREE *complexity_tree;
+  /** a grok for each pattern worth trying, most complex first */
+  grok_t *groks;
+  /** complexity() of each grok; more negative is more complex */
+  int *complexities;
+  int ngroks;
   grok_t *base_grok;
   unsigned int logmask;
   unsigned int logdepth;
@@ -16,7 +26,53 @@ grok_discover_t *grok_discover_new(grok_t *source_grok);
 void grok_discover_init(grok_discover_t *gdt, grok_t *source_grok);
 void grok_discover_clean(grok_discover_t *gdt);
 void grok_discover_free(grok_discover_t *gdt);
+
+/**
+ * Replace known patterns in input with %{NAME} references.
+ *
+ * @param discovery set to the discovered pattern, which the caller must
+ *        free().
+ */
 void grok_discover(const grok_discover_t *gdt, /*grok_t *dest_grok,*/
                    const char *input, char **discovery, int *discovery_len);
 
+/**
+ * A pattern found by grok_discover_corpus(), and how much of the corpus it
+ * covers.
+ */
+typedef struct grok_discover_result {
+  char *pattern;
+  int pattern_len;
+
+  /** lines in the clusters this pattern was discovered from */
+  int lines;
+
+  /** of those, lines the anchored pattern matches */
+  int matched;
+
+  /** index of the first line the pattern was discovered from */
+  int representative;
+} grok_discover_result_t;
+
+/**
+ * Suggest patterns for a corpus of lines. Lines are clustered by
+ * grok_shape_fingerprint(); each cluster's first line goes through
+ * grok_discover(), and the result is compiled, anchored, and checked
+ * against every line of its cluster. Clusters that come up with the same
+ * pattern are merged.
+ *
+ * @param lines the lines, which needn't be NUL-terminated.
+ * @param line_lens the length of each line.
+ * @param nthreads threads to spread clusters across; 0 or less means one
+ *        per online CPU.
+ * @param results set to an array of patterns, most matched lines first,
+ *        to be released with grok_discover_results_free().
+ * @returns the number of results.
+ */
+int grok_discover_corpus(const grok_discover_t *gdt, const char * const *lines,
+                         const int *line_lens, int nlines, int nthreads,
+                         grok_discover_result_t **results);
+
+void grok_discover_results_free(grok_discover_result_t *results, int nresults);
+
 #endif /* _GROK_DISCOVER_H_ */
@@ -0,0 +1,312 @@
+#include "grok.h"
+#include "grok_drain.h"
+#include "stringhelper.h"
+
+#include <ctype.h>
+
+/* Wildcard types, most specific first */
+static const char *drain_type_names[GROK_DRAIN_NTYPES] = {
+  "INT", "NUMBER", "IP", "WORD", "NOTSPACE"
+};
+
+/* Tokens past this many are ignored */
+#define DRAIN_MAX_TOKENS 256
+
+typedef struct drain_token {
+  const char *str;
+  int len;
+} drain_token_t;
+
+static int drain_tokenize(const char *line, int len, drain_token_t *tokens) {
+  int ntokens = 0;
+  int pos = 0;
+  while (pos < len && ntokens < DRAIN_MAX_TOKENS) {
+    int start;
+    while (pos < len && isspace((unsigned char)line[pos])) {
+      pos++;
+    }
+    if (pos == len) {
+      break;
+    }
+    start = pos;
+    while (pos < len && !isspace((unsigned char)line[pos])) {
+      pos++;
+    }
+    tokens[ntokens].str = line + start;
+    tokens[ntokens].len = pos - start;
+    ntokens++;
+  }
+  return ntokens;
+}
+
+/* Tokens with digits in them are likely to vary, so they route as a
+ * wildcard */
+static int drain_has_digit(const drain_token_t *token) {
+  int i;
+  for (i = 0; i < token->len; i++) {
+    if (isdigit((unsigned char)token->str[i])) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/* Bit for each type that matches the whole token */
+static unsigned int drain_types(const grok_drain_t *drain, const char *str,
+                                int len) {
+  unsigned int types = 0;
+  int i;
+  for (i = 0; i < GROK_DRAIN_NTYPES; i++) {
+    if (drain->type_groks[i] != NULL
+        && grok_execn(drain->type_groks[i], str, len, NULL) == GROK_OK) {
+      types |= 1 << i;
+    }
+  }
+  return types;
+}
+
+void grok_drain_init(grok_drain_t *drain, const grok_t *library, int depth,
+                     double similarity) {
+  int i;
+
+  drain->routes = tctreenew();
+  drain->groups = NULL;
+  drain->ngroup = NULL;
+  drain->ngroups = 0;
+  drain->groups_size = 0;
+  drain->templates = NULL;
+  drain->ntemplates = 0;
+  drain->templates_size = 0;
+  drain->depth = (depth < 0) ? 0 : depth;
+  drain->similarity = similarity;
+  drain->logmask = library->logmask;
+  drain->logdepth = library->logdepth;
+
+  for (i = 0; i < GROK_DRAIN_NTYPES; i++) {
+    const char *name = drain_type_names[i];
+    const char *regexp;
+    size_t regexp_len;
+    char *pattern;
+    grok_t *g;
+
+    drain->type_groks[i] = NULL;
+    grok_pattern_find(library, name, strlen(name), &regexp, &regexp_len);
+    if (regexp == NULL) {
+      continue;
+    }
+
+    g = grok_new();
+    grok_clone(g, library);
+    if (asprintf(&pattern, "^%%{%s}$", name) == -1) {
+      perror("asprintf failed");
+      abort();
+    }
+    if (grok_compile(g, pattern, false) != GROK_OK) {
+      free(pattern);
+      grok_free_clone(g);
+      free(g);
+      continue;
+    }
+    drain->type_groks[i] = g;
+  }
+}
+
+void grok_drain_clean(grok_drain_t *drain) {
+  int i, j;
+
+  for (i = 0; i < drain->ntemplates; i++) {
+    grok_drain_template_t *t = drain->templates + i;
+    for (j = 0; j < t->ntokens; j++) {
+      free(t->tokens[j]);
+    }
+    free(t->tokens);
+    free(t->token_lens);
+    free(t->types);
+  }
+  free(drain->templates);
+
+  for (i = 0; i < drain->ngroups; i++) {
+    free(drain->groups[i]);
+  }
+  free(drain->groups);
+  free(drain->ngroup);
+  tctreedel(drain->routes);
+
+  for (i = 0; i < GROK_DRAIN_NTYPES; i++) {
+    if (drain->type_groks[i] != NULL) {
+      free((void *)drain->type_groks[i]->pattern);
+      grok_free_clone(drain->type_groks[i]);
+      free(drain->type_groks[i]);
+    }
+  }
+}
+
+/* Find or create the group for a line's token count and leading tokens */
+static int drain_route(grok_drain_t *drain, const drain_token_t *tokens,
+                       int ntokens) {
+  char *key;
+  int key_len;
+  int key_size = 16;
+  const int *found;
+  int size;
+  int group;
+  int i;
+
+  for (i = 0; i < ntokens && i < drain->depth; i++) {
+    key_size += 1 + ((tokens[i].len > 3) ? tokens[i].len : 3);
+  }
+  key = malloc(key_size);
+  key_len = sprintf(key, "%d", ntokens);
+  for (i = 0; i < ntokens && i < drain->depth; i++) {
+    key[key_len++] = ' ';
+    if (drain_has_digit(tokens + i)) {
+      memcpy(key + key_len, "<*>", 3);
+      key_len += 3;
+    } else {
+      memcpy(key + key_len, tokens[i].str, tokens[i].len);
+      key_len += tokens[i].len;
+    }
+  }
+
+  found = tctreeget(drain->routes, key, key_len, &size);
+  if (found != NULL) {
+    free(key);
+    return *found;
+  }
+
+  if (drain->ngroups == drain->groups_size) {
+    drain->groups_size = (drain->groups_size == 0) ? 16 : drain->groups_size * 2;
+    drain->groups = realloc(drain->groups, drain->groups_size * sizeof(int *));
+    drain->ngroup = realloc(drain->ngroup, drain->groups_size * sizeof(int));
+  }
+  group = drain->ngroups++;
+  drain->groups[group] = NULL;
+  drain->ngroup[group] = 0;
+  tctreeput(drain->routes, key, key_len, &group, sizeof(int));
+  free(key);
+  return group;
+}
+
+static int drain_new_template(grok_drain_t *drain, int group,
+                              const drain_token_t *tokens, int ntokens) {
+  grok_drain_template_t *t;
+  int id, i;
+
+  if (drain->ntemplates == drain->templates_size) {
+    drain->templates_size = (drain->templates_size == 0)
+                            ? 16 : drain->templates_size * 2;
+    drain->templates = realloc(drain->templates, drain->templates_size
+                               * sizeof(grok_drain_template_t));
+  }
+  id = drain->ntemplates++;
+  t = drain->templates + id;
+  t->ntokens = ntokens;
+  t->tokens = malloc(ntokens * sizeof(char *) + 1);
+  t->token_lens = malloc(ntokens * sizeof(int) + 1);
+  t->types = calloc(ntokens + 1, sizeof(unsigned int));
+  t->count = 1;
+  for (i = 0; i < ntokens; i++) {
+    t->tokens[i] = string_ndup(tokens[i].str, tokens[i].len);
+    t->token_lens[i] = tokens[i].len;
+  }
+
+  drain->groups[group] = realloc(drain->groups[group],
+                                 (drain->ngroup[group] + 1) * sizeof(int));
+  drain->groups[group][drain->ngroup[group]++] = id;
+  return id;
+}
+
+int grok_drain_add(grok_drain_t *drain, const char *line, int len) {
+  drain_token_t tokens[DRAIN_MAX_TOKENS];
+  int ntokens;
+  int group;
+  int best = -1;
+  double best_similarity = -1;
+  grok_drain_template_t *t;
+  int i, j;
+
+  ntokens = drain_tokenize(line, len, tokens);
+  group = drain_route(drain, tokens, ntokens);
+
+  /* The most similar template in the group: the fraction of positions
+   * where the template has the line's token */
+  for (i = 0; i < drain->ngroup[group]; i++) {
+    int id = drain->groups[group][i];
+    int same = 0;
+    double similarity;
+    t = drain->templates + id;
+    for (j = 0; j < ntokens; j++) {
+      if (t->tokens[j] != NULL && t->token_lens[j] == tokens[j].len
+          && !memcmp(t->tokens[j], tokens[j].str, tokens[j].len)) {
+        same++;
+      }
+    }
+    similarity = (ntokens == 0) ? 1 : (double)same / ntokens;
+    if (similarity > best_similarity) {
+      best_similarity = similarity;
+      best = id;
+    }
+  }
+
+  if (best < 0 || best_similarity < drain->similarity) {
+    best = drain_new_template(drain, group, tokens, ntokens);
+    grok_log(drain, LOG_DISCOVER, "New template %d: %.*s", best, len, line);
+    return best;
+  }
+
+  /* Merge: positions that differ become wildcards */
+  t = drain->templates + best;
+  t->count++;
+  for (j = 0; j < ntokens; j++) {
+    if (t->tokens[j] == NULL) {
+      t->types[j] &= drain_types(drain, tokens[j].str, tokens[j].len);
+    } else if (t->token_lens[j] != tokens[j].len
+               || memcmp(t->tokens[j], tokens[j].str, tokens[j].len)) {
+      t->types[j] = drain_types(drain, t->tokens[j], t->token_lens[j])
+                    & drain_types(drain, tokens[j].str, tokens[j].len);
+      free(t->tokens[j]);
+      t->tokens[j] = NULL;
+    }
+  }
+  grok_log(drain, LOG_DISCOVER, "Merged into template %d: %.*s", best, len,
+           line);
+  return best;
+}
+
+void grok_drain_pattern(const grok_drain_t *drain, int template,
+                        char **pattern, int *pattern_len) {
+  const grok_drain_template_t *t = drain->templates + template;
+  char *out = NULL;
+  int out_len = 0;
+  int out_size = 0;
+  int i, j;
+
+  substr_replace(&out, &out_len, &out_size, 0, 0, "", 0);
+  for (i = 0; i < t->ntokens; i++) {
+    if (i > 0) {
+      substr_replace(&out, &out_len, &out_size, out_len, out_len, "\\s+", 3);
+    }
+
+    if (t->tokens[i] != NULL) {
+      /* Escape anything PCRE or grok would treat specially */
+      for (j = 0; j < t->token_lens[i]; j++) {
+        char c = t->tokens[i][j];
+        if (c != '\0' && strchr("\\^$.|?*+()[]{}%", c) != NULL) {
+          substr_replace(&out, &out_len, &out_size, out_len, out_len, "\\", 1);
+        }
+        substr_replace(&out, &out_len, &out_size, out_len, out_len, &c, 1);
+      }
+    } else if (t->types[i] != 0) {
+      int type = __builtin_ctz(t->types[i]);
+      substr_replace(&out, &out_len, &out_size, out_len, out_len, "%{", 2);
+      substr_replace(&out, &out_len, &out_size, out_len, out_len,
+                     drain_type_names[type], strlen(drain_type_names[type]));
+      substr_replace(&out, &out_len, &out_size, out_len, out_len, "}", 1);
+    } else {
+      substr_replace(&out, &out_len, &out_size, out_len, out_len, "\\S+", 3);
+    }
+  }
+
+  *pattern = out;
+  *pattern_len = out_len;
+}
@@ -0,0 +1,95 @@
+/**
+ * @file grok_drain.h
+ */
+#ifndef _GROK_DRAIN_H_
+#define _GROK_DRAIN_H_
+#include "grok.h"
+
+/** Number of simple patterns wildcard positions are typed with */
+#define GROK_DRAIN_NTYPES 5
+
+/**
+ * A line template: whitespace separated tokens, some of which have varied
+ * between the lines merged into it.
+ */
+typedef struct grok_drain_template {
+  int ntokens;
+
+  /** token i, or NULL where the lines differ */
+  char **tokens;
+  int *token_lens;
+
+  /** For wildcard positions, a bit for each of the miner's types that
+   * every value seen there matched */
+  unsigned int *types;
+
+  /** lines merged into this template */
+  int count;
+} grok_drain_template_t;
+
+/**
+ * Mines line templates from logs in the style of Drain (He et al., 2017):
+ * lines are routed by their token count and first few tokens to a small
+ * group of templates, and merged into the most similar one, or start a new
+ * one. Each line costs a few lookups plus a pass over its tokens per
+ * template in its group.
+ *
+ * Not safe to use from more than one thread at once.
+ */
+typedef struct grok_drain {
+  /** token count and leading tokens -> index of a group in groups */
+  TCTREE *routes;
+
+  /** Groups of template indexes; group i has ngroup[i] templates in
+   * groups[i] */
+  int **groups;
+  int *ngroup;
+  int ngroups;
+  int groups_size;
+
+  grok_drain_template_t *templates;
+  int ntemplates;
+  int templates_size;
+
+  /** leading tokens used for routing */
+  int depth;
+
+  /** fraction of positions that must agree to merge into a template */
+  double similarity;
+
+  /** anchored groks for typing wildcards, NULL if the library lacks one */
+  grok_t *type_groks[GROK_DRAIN_NTYPES];
+
+  unsigned int logmask;
+  unsigned int logdepth;
+} grok_drain_t;
+
+/**
+ * @param library grok whose patterns are used to type wildcards, which
+ *        must outlive the miner.
+ * @param depth how many leading tokens route a line, at least 0.
+ * @param similarity fraction of tokens that must match a template for a
+ *        line to be merged into it, like 0.4.
+ */
+void grok_drain_init(grok_drain_t *drain, const grok_t *library, int depth,
+                     double similarity);
+void grok_drain_clean(grok_drain_t *drain);
+
+/**
+ * Merge a line into the miner's templates.
+ *
+ * @returns the index of the template the line went to.
+ */
+int grok_drain_add(grok_drain_t *drain, const char *line, int len);
+
+/**
+ * Write a template as a grok expression. Literal tokens are quoted,
+ * wildcards become the most specific of %{INT}, %{NUMBER}, %{IP}, %{WORD}
+ * and %{NOTSPACE} that matched every value seen, or \S+.
+ *
+ * @param pattern set to the expression, which the caller must free().
+ */
+void grok_drain_pattern(const grok_drain_t *drain, int template,
+                        char **pattern, int *pattern_len);
+
+#endif /* _GROK_DRAIN_H_ */
@@ -0,0 +1,615 @@
+#include <ctype.h>
+
+#include "grok.h"
+#include "grok_literal.h"
+
+/* Longest literal run we collect before splitting it */
+#define LITERAL_RUN_MAX 256
+
+typedef struct literal_parser {
+  const char *p;
+  const char *end;
+  int min_len;
+  int bail;
+} literal_parser_t;
+
+typedef struct literal_run {
+  char buf[LITERAL_RUN_MAX];
+  int len;
+} literal_run_t;
+
+enum { ATOM_CHAR, ATOM_OTHER, ATOM_ZERO, ATOM_ANCHOR, ATOM_GROUP };
+
+static void parse_alternation(literal_parser_t *lp, TCLIST *out);
+static void parse_sequence(literal_parser_t *lp, TCLIST *out);
+static int parse_escape(literal_parser_t *lp, unsigned char *c);
+static void parse_quantifier(literal_parser_t *lp, int *optional, int *repeats);
+static void skip_class(literal_parser_t *lp);
+static void skip_group(literal_parser_t *lp);
+
+static void run_flush(literal_parser_t *lp, literal_run_t *run, TCLIST *out) {
+  if (run->len >= lp->min_len) {
+    tclistpush(out, run->buf, run->len);
+  }
+  run->len = 0;
+}
+
+static void run_append(literal_parser_t *lp, literal_run_t *run, TCLIST *out,
+                       unsigned char c) {
+  if (run->len == LITERAL_RUN_MAX) {
+    run_flush(lp, run, out);
+  }
+  run->buf[run->len++] = c;
+}
+
+int grok_literal_extract(const char *pattern, int pattern_len, int min_len,
+                         TCLIST *literals) {
+  literal_parser_t lp;
+  TCLIST *found = tclistnew();
+  int i, count = 0;
+
+  lp.p = pattern;
+  lp.end = pattern + pattern_len;
+  lp.min_len = (min_len < 1) ? 1 : min_len;
+  lp.bail = 0;
+
+  /* An unbalanced ')' ends parse_alternation early; treat it as unparseable */
+  parse_alternation(&lp, found);
+  if (lp.p < lp.end) {
+    lp.bail = 1;
+  }
+
+  if (!lp.bail) {
+    count = tclistnum(found);
+    for (i = 0; i < count; i++) {
+      int size;
+      const void *literal = tclistval(found, i, &size);
+      tclistpush(literals, literal, size);
+    }
+  }
+  tclistdel(found);
+  return count;
+}
+
+/* Parse branches up to an unmatched ')' or the end of the pattern. Only a
+ * single branch contributes literals: with several, none is required. */
+static void parse_alternation(literal_parser_t *lp, TCLIST *out) {
+  TCLIST *branch = tclistnew();
+  int branches = 1;
+
+  parse_sequence(lp, branch);
+  while (lp->p < lp->end && *lp->p == '|') {
+    lp->p++;
+    branches++;
+    parse_sequence(lp, branch);
+  }
+
+  if (branches == 1) {
+    int i, size;
+    for (i = 0; i < tclistnum(branch); i++) {
+      const void *literal = tclistval(branch, i, &size);
+      tclistpush(out, literal, size);
+    }
+  }
+  tclistdel(branch);
+}
+
+static void parse_sequence(literal_parser_t *lp, TCLIST *out) {
+  literal_run_t run;
+  run.len = 0;
+
+  while (lp->p < lp->end && *lp->p != '|' && *lp->p != ')' && !lp->bail) {
+    unsigned char c = 0;
+    int atom = ATOM_OTHER;
+    int optional, repeats;
+    TCLIST *inner = NULL;
+
+    switch (*lp->p) {
+      case '\\':
+        if (lp->p + 1 < lp->end && lp->p[1] == 'Q') {
+          /* \Q...\E is all literal, except a quantifier after \E applies
+           * to the last character only */
+          const char *q = lp->p + 2;
+          const char *qend = q;
+          while (qend < lp->end
+                 && !(qend[0] == '\\' && qend + 1 < lp->end && qend[1] == 'E')) {
+            qend++;
+          }
+          lp->p = (qend < lp->end) ? qend + 2 : qend;
+          if (q == qend) {
+            atom = ATOM_ZERO;
+            break;
+          }
+          for (; q < qend - 1; q++) {
+            run_append(lp, &run, out, *q);
+          }
+          c = *q;
+          atom = ATOM_CHAR;
+        } else {
+          atom = parse_escape(lp, &c);
+        }
+        break;
+      case '[':
+        skip_class(lp);
+        atom = ATOM_OTHER;
+        break;
+      case '.':
+        lp->p++;
+        atom = ATOM_OTHER;
+        break;
+      case '^':
+      case '$':
+        lp->p++;
+        atom = ATOM_ANCHOR;
+        break;
+      case '(':
+        if (lp->p + 1 < lp->end && lp->p[1] == '*') {
+          /* (*VERB) */
+          skip_group(lp);
+          atom = ATOM_OTHER;
+          break;
+        }
+        if (lp->p + 1 < lp->end && lp->p[1] == '?') {
+          const char *q = lp->p + 2;
+          if (q >= lp->end) {
+            lp->bail = 1;
+            break;
+          }
+          if (*q == '#' || *q == 'C') {
+            /* comment or callout */
+            while (lp->p < lp->end && *lp->p != ')') lp->p++;
+            if (lp->p < lp->end) lp->p++;
+            atom = ATOM_ZERO;
+            break;
+          }
+          if (*q == '=' || *q == '!' || *q == '('
+              || (*q == '<' && q + 1 < lp->end && (q[1] == '=' || q[1] == '!'))) {
+            /* lookaround or conditional */
+            skip_group(lp);
+            atom = ATOM_ANCHOR;
+            break;
+          }
+          if (*q == 'R' || *q == '&' || *q == '+' || (*q == '-' && q + 1 < lp->end && isdigit(q[1]))
+              || isdigit(*q) || (*q == 'P' && q + 1 < lp->end && (q[1] == '>' || q[1] == '='))) {
+            /* recursion, subroutine call or named backreference */
+            skip_group(lp);
+            atom = ATOM_OTHER;
+            break;
+          }
+          if (*q == ':' || *q == '>' || *q == '|') {
+            lp->p = q + 1;
+          } else if (*q == '<' || *q == '\'' || (*q == 'P' && q + 1 < lp->end && q[1] == '<')) {
+            /* named group */
+            char close = (*q == '\'') ? '\'' : '>';
+            q++;
+            while (q < lp->end && *q != close) q++;
+            lp->p = q + 1;
+          } else {
+            /* option setting, (?i) or (?i:...) */
+            int options_group = 0;
+            while (q < lp->end && (isalpha(*q) || *q == '-')) {
+              if (*q == 'i' || *q == 'x') {
+                lp->bail = 1;
+              }
+              q++;
+            }
+            if (q >= lp->end || (*q != ')' && *q != ':')) {
+              lp->bail = 1;
+            }
+            if (lp->bail) {
+              break;
+            }
+            options_group = (*q == ':');
+            lp->p = q + 1;
+            if (!options_group) {
+              atom = ATOM_ZERO;
+              break;
+            }
+          }
+        } else {
+          lp->p++;
+        }
+
+        inner = tclistnew();
+        parse_alternation(lp, inner);
+        if (lp->p >= lp->end || *lp->p != ')') {
+          lp->bail = 1;
+          tclistdel(inner);
+          inner = NULL;
+          break;
+        }
+        lp->p++;
+        atom = ATOM_GROUP;
+        break;
+      default:
+        c = *lp->p++;
+        atom = ATOM_CHAR;
+    }
+
+    if (lp->bail) {
+      if (inner != NULL) tclistdel(inner);
+      break;
+    }
+
+    parse_quantifier(lp, &optional, &repeats);
+
+    if (atom == ATOM_ZERO) {
+      /* zero-width, so the run continues across it */
+      continue;
+    }
+
+    switch (atom) {
+      case ATOM_CHAR:
+        if (optional) {
+          run_flush(lp, &run, out);
+        } else {
+          run_append(lp, &run, out, c);
+          if (repeats) {
+            run_flush(lp, &run, out);
+          }
+        }
+        break;
+      case ATOM_GROUP:
+        run_flush(lp, &run, out);
+        if (!optional) {
+          int i, size;
+          for (i = 0; i < tclistnum(inner); i++) {
+            const void *literal = tclistval(inner, i, &size);
+            tclistpush(out, literal, size);
+          }
+        }
+        tclistdel(inner);
+        break;
+      default:
+        run_flush(lp, &run, out);
+    }
+  }
+
+  run_flush(lp, &run, out);
+}
+
+/* Parse the escape at lp->p. Sets *c and returns ATOM_CHAR if it stands for
+ * a literal byte. */
+static int parse_escape(literal_parser_t *lp, unsigned char *c) {
+  unsigned char e;
+
+  lp->p++; /* skip the backslash */
+  if (lp->p >= lp->end) {
+    lp->bail = 1;
+    return ATOM_OTHER;
+  }
+
+  e = *lp->p++;
+  if (!isalnum(e)) {
+    *c = e;
+    return ATOM_CHAR;
+  }
+
+  switch (e) {
+    case 't': *c = '\t'; return ATOM_CHAR;
+    case 'n': *c = '\n'; return ATOM_CHAR;
+    case 'r': *c = '\r'; return ATOM_CHAR;
+    case 'f': *c = '\f'; return ATOM_CHAR;
+    case 'a': *c = '\a'; return ATOM_CHAR;
+    case 'e': *c = 27; return ATOM_CHAR;
+    case 'x':
+      if (lp->p < lp->end && *lp->p == '{') {
+        /* \x{...} can be wider than a byte; don't bother */
+        while (lp->p < lp->end && *lp->p != '}') lp->p++;
+        if (lp->p < lp->end) lp->p++;
+        return ATOM_OTHER;
+      } else {
+        int value = 0, digits = 0;
+        while (digits < 2 && lp->p < lp->end && isxdigit(*lp->p)) {
+          char h = tolower(*lp->p++);
+          value = value * 16 + (isdigit(h) ? h - '0' : h - 'a' + 10);
+          digits++;
+        }
+        *c = value;
+        return ATOM_CHAR;
+      }
+    case 'b': case 'B': case 'A': case 'z': case 'Z': case 'G':
+      return ATOM_ZERO;
+    case 'E':
+      return ATOM_ZERO;
+    case 'p': case 'P': case 'g': case 'k':
+      /* \p{..}, \g{..}, \k<..> and friends */
+      if (lp->p < lp->end && strchr("{<'", *lp->p) != NULL) {
+        char close = (*lp->p == '{') ? '}' : (*lp->p == '<') ? '>' : '\'';
+        while (lp->p < lp->end && *lp->p != close) lp->p++;
+        if (lp->p < lp->end) lp->p++;
+      } else if (e == 'g') {
+        if (lp->p < lp->end && *lp->p == '-') lp->p++;
+        while (lp->p < lp->end && isdigit(*lp->p)) lp->p++;
+      } else if (lp->p < lp->end) {
+        lp->p++;
+      }
+      return ATOM_OTHER;
+    case 'c':
+      if (lp->p < lp->end) lp->p++;
+      return ATOM_OTHER;
+    default:
+      /* \d, \w, \s, backreferences, octal and the rest */
+      while (isdigit(e) && lp->p < lp->end && isdigit(*lp->p)) lp->p++;
+      return ATOM_OTHER;
+  }
+}
+
+static void parse_quantifier(literal_parser_t *lp, int *optional, int *repeats) {
+  *optional = 0;
+  *repeats = 0;
+
+  if (lp->p >= lp->end) {
+    return;
+  }
+
+  switch (*lp->p) {
+    case '?': *optional = 1; lp->p++; break;
+    case '*': *optional = 1; *repeats = 1; lp->p++; break;
+    case '+': *repeats = 1; lp->p++; break;
+    case '{': {
+      /* {n}, {n,} or {n,m}; anything else is a literal '{' */
+      const char *q = lp->p + 1;
+      int min = 0, max = -1, digits = 0;
+      while (q < lp->end && isdigit(*q)) {
+        min = min * 10 + (*q++ - '0');
+        digits++;
+      }
+      if (digits == 0 || q >= lp->end) {
+        return;
+      }
+      if (*q == '}') {
+        max = min;
+      } else if (*q == ',') {
+        q++;
+        if (q < lp->end && isdigit(*q)) {
+          max = 0;
+          while (q < lp->end && isdigit(*q)) max = max * 10 + (*q++ - '0');
+        }
+        if (q >= lp->end || *q != '}') {
+          return;
+        }
+      } else {
+        return;
+      }
+      lp->p = q + 1;
+      *optional = (min == 0);
+      *repeats = (max != 1);
+      break;
+    }
+    default:
+      return;
+  }
+
+  /* lazy or possessive suffix */
+  if (lp->p < lp->end && (*lp->p == '?' || *lp->p == '+')) {
+    lp->p++;
+  }
+}
+
+static void skip_class(literal_parser_t *lp) {
+  lp->p++; /* '[' */
+  if (lp->p < lp->end && *lp->p == '^') lp->p++;
+  if (lp->p < lp->end && *lp->p == ']') lp->p++;
+  while (lp->p < lp->end && *lp->p != ']') {
+    if (*lp->p == '\\') {
+      lp->p++;
+    } else if (*lp->p == '[' && lp->p + 1 < lp->end && lp->p[1] == ':') {
+      const char *close = strstr(lp->p + 2, ":]");
+      if (close != NULL && close < lp->end) {
+        lp->p = close + 1;
+      }
+    }
+    lp->p++;
+  }
+  if (lp->p >= lp->end) {
+    lp->bail = 1;
+    return;
+  }
+  lp->p++; /* ']' */
+}
+
+/* Skip a balanced group starting at the '(' at lp->p */
+static void skip_group(literal_parser_t *lp) {
+  int depth = 0;
+
+  while (lp->p < lp->end) {
+    switch (*lp->p) {
+      case '\\':
+        lp->p += 2;
+        continue;
+      case '[':
+        skip_class(lp);
+        continue;
+      case '(':
+        depth++;
+        break;
+      case ')':
+        depth--;
+        break;
+    }
+    lp->p++;
+    if (depth == 0) {
+      return;
+    }
+  }
+  lp->bail = 1;
+}
+
+void grok_literal_index_init(grok_literal_index_t *idx) {
+  idx->ids = tctreenew();
+  idx->literals = tclistnew();
+  idx->nliterals = 0;
+  memset(idx->classes, 0, sizeof(idx->classes));
+  idx->nclasses = 1;
+  idx->delta = NULL;
+  idx->nstates = 0;
+  idx->output_start = NULL;
+  idx->outputs = NULL;
+}
+
+void grok_literal_index_clean(grok_literal_index_t *idx) {
+  if (idx->ids != NULL) {
+    tctreedel(idx->ids);
+    idx->ids = NULL;
+  }
+  if (idx->literals != NULL) {
+    tclistdel(idx->literals);
+    idx->literals = NULL;
+  }
+  free(idx->delta);
+  free(idx->output_start);
+  free(idx->outputs);
+  idx->delta = NULL;
+  idx->output_start = NULL;
+  idx->outputs = NULL;
+  idx->nstates = 0;
+  idx->nliterals = 0;
+}
+
+int grok_literal_index_add(grok_literal_index_t *idx, const char *literal,
+                           int literal_len) {
+  int size;
+  const int *id = tctreeget(idx->ids, literal, literal_len, &size);
+  int new_id;
+
+  if (id != NULL) {
+    return *id;
+  }
+
+  new_id = idx->nliterals++;
+  tctreeput(idx->ids, literal, literal_len, &new_id, sizeof(new_id));
+  tclistpush(idx->literals, literal, literal_len);
+  return new_id;
+}
+
+void grok_literal_index_build(grok_literal_index_t *idx) {
+  int i, j, s, cls;
+  int max_states = 1;
+  int *own, *fail, *order, *count;
+  int head = 0, tail = 0, total = 0;
+
+  for (i = 0; i < idx->nliterals; i++) {
+    int len;
+    const unsigned char *literal = tclistval(idx->literals, i, &len);
+    for (j = 0; j < len; j++) {
+      if (idx->classes[literal[j]] == 0) {
+        idx->classes[literal[j]] = idx->nclasses++;
+      }
+    }
+    max_states += len;
+  }
+
+  idx->delta = malloc(max_states * idx->nclasses * sizeof(int));
+  own = malloc(max_states * sizeof(int));
+  fail = malloc(max_states * sizeof(int));
+  order = malloc(max_states * sizeof(int));
+  count = malloc(max_states * sizeof(int));
+
+  /* Build the trie of all literals */
+  idx->nstates = 1;
+  own[0] = -1;
+  for (cls = 0; cls < idx->nclasses; cls++) {
+    idx->delta[cls] = -1;
+  }
+  for (i = 0; i < idx->nliterals; i++) {
+    int len;
+    const unsigned char *literal = tclistval(idx->literals, i, &len);
+    s = 0;
+    for (j = 0; j < len; j++) {
+      int *next = idx->delta + s * idx->nclasses + idx->classes[literal[j]];
+      if (*next < 0) {
+        *next = idx->nstates++;
+        own[*next] = -1;
+        for (cls = 0; cls < idx->nclasses; cls++) {
+          idx->delta[*next * idx->nclasses + cls] = -1;
+        }
+      }
+      s = *next;
+    }
+    own[s] = i;
+  }
+
+  /* Breadth-first, fill in failure transitions so delta becomes a DFA */
+  fail[0] = 0;
+  order[tail++] = 0;
+  for (cls = 0; cls < idx->nclasses; cls++) {
+    int *next = idx->delta + cls;
+    if (*next < 0) {
+      *next = 0;
+    } else {
+      fail[*next] = 0;
+      order[tail++] = *next;
+    }
+  }
+  head = 1;
+  while (head < tail) {
+    s = order[head++];
+    for (cls = 0; cls < idx->nclasses; cls++) {
+      int *next = idx->delta + s * idx->nclasses + cls;
+      int fallback = idx->delta[fail[s] * idx->nclasses + cls];
+      if (*next < 0) {
+        *next = fallback;
+      } else {
+        fail[*next] = fallback;
+        order[tail++] = *next;
+      }
+    }
+  }
+
+  /* Each state reports its own literal plus everything its failure state
+   * reports. Failure states come earlier in breadth-first order. */
+  for (i = 0; i < tail; i++) {
+    s = order[i];
+    count[s] = (own[s] >= 0) + ((s == 0) ? 0 : count[fail[s]]);
+    total += count[s];
+  }
+  idx->output_start = malloc((idx->nstates + 1) * sizeof(int));
+  idx->outputs = malloc((total > 0 ? total : 1) * sizeof(int));
+  idx->output_start[0] = 0;
+  for (s = 0; s < idx->nstates; s++) {
+    idx->output_start[s + 1] = idx->output_start[s] + count[s];
+  }
+  for (i = 0; i < tail; i++) {
+    int *out;
+    s = order[i];
+    out = idx->outputs + idx->output_start[s];
+    if (own[s] >= 0) {
+      *out++ = own[s];
+    }
+    if (s != 0) {
+      memcpy(out, idx->outputs + idx->output_start[fail[s]],
+             count[fail[s]] * sizeof(int));
+    }
+  }
+
+  free(own);
+  free(fail);
+  free(order);
+  free(count);
+
+  /* Only the automaton is needed from here on */
+  tctreedel(idx->ids);
+  tclistdel(idx->literals);
+  idx->ids = NULL;
+  idx->literals = NULL;
+}
+
+void grok_literal_index_scan(const grok_literal_index_t *idx,
+                             const char *text, int textlen, uint64_t *seen) {
+  const unsigned char *p = (const unsigned char *)text;
+  const unsigned char *end = p + textlen;
+  int s = 0;
+
+  if (idx->nliterals == 0) {
+    return;
+  }
+
+  for (; p < end; p++) {
+    int o;
+    s = idx->delta[s * idx->nclasses + idx->classes[*p]];
+    for (o = idx->output_start[s]; o < idx->output_start[s + 1]; o++) {
+      GROK_BITSET_SET(seen, idx->outputs[o]);
+    }
+  }
+}
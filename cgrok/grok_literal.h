@@ -0,0 +1,76 @@
+/**
+ * @file grok_literal.h
+ */
+#ifndef _GROK_LITERAL_H_
+#define _GROK_LITERAL_H_
+#include "grok.h"
+
+/* Fixed-size bitsets, stored as arrays of uint64_t */
+#define GROK_BITSET_WORDS(n) (((n) + 63) / 64)
+#define GROK_BITSET_SET(set, i) ((set)[(i) / 64] |= ((uint64_t)1 << ((i) % 64)))
+#define GROK_BITSET_CLEAR(set, i) ((set)[(i) / 64] &= ~((uint64_t)1 << ((i) % 64)))
+#define GROK_BITSET_TEST(set, i) (((set)[(i) / 64] >> ((i) % 64)) & 1)
+
+/**
+ * An Aho-Corasick automaton over a set of literal strings. One pass over
+ * a subject reports every literal that occurs in it.
+ */
+typedef struct grok_literal_index {
+  /** literal string -> literal id, used to deduplicate while adding */
+  TCTREE *ids;
+  /** literal id -> literal string, kept until grok_literal_index_build() */
+  TCLIST *literals;
+  int nliterals;
+
+  /** byte -> input class. Bytes appearing in no literal share class 0. */
+  unsigned char classes[256];
+  int nclasses;
+
+  /** state * nclasses + class -> next state */
+  int *delta;
+  int nstates;
+
+  /** literal ids recognized in each state are
+   * outputs[output_start[state] .. output_start[state + 1]) */
+  int *output_start;
+  int *outputs;
+} grok_literal_index_t;
+
+void grok_literal_index_init(grok_literal_index_t *idx);
+void grok_literal_index_clean(grok_literal_index_t *idx);
+
+/**
+ * Add a literal to the index, before grok_literal_index_build().
+ *
+ * @returns the literal's id. Adding the same literal twice gives the same id.
+ */
+int grok_literal_index_add(grok_literal_index_t *idx, const char *literal,
+                           int literal_len);
+
+/**
+ * Build the automaton. No literals can be added afterwards.
+ */
+void grok_literal_index_build(grok_literal_index_t *idx);
+
+/**
+ * Scan text, setting the bit for each literal id found in it. seen must
+ * have GROK_BITSET_WORDS(idx->nliterals) words, zeroed by the caller.
+ */
+void grok_literal_index_scan(const grok_literal_index_t *idx,
+                             const char *text, int textlen, uint64_t *seen);
+
+/**
+ * Find literal strings that must appear in any match of a regexp.
+ *
+ * This is conservative: alternations, optional groups and anything it
+ * doesn't understand contribute nothing, and a case-insensitive or
+ * extended-mode pattern yields no literals at all.
+ *
+ * @param literals each required literal of at least min_len bytes is
+ *        pushed onto this list.
+ * @returns the number of literals pushed.
+ */
+int grok_literal_extract(const char *pattern, int pattern_len, int min_len,
+                         TCLIST *literals);
+
+#endif /* _GROK_LITERAL_H_ */
@@ -26,6 +26,7 @@ inline void _grok_log(int level, int indent, const char *format, ...) {
     case LOG_REACTION: prefix = "[reaction] "; break;
     case LOG_REGEXPAND: prefix = "[regexpand] "; break;
     case LOG_DISCOVER: prefix = "[discover] "; break;
+    case LOG_PILE: prefix = "[pile] "; break;
     default: prefix = "[unknown] ";
   }
 #ifdef _WIN64
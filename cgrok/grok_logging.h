@@ -14,6 +14,7 @@
 #define LOG_PROGRAMINPUT (1 << 8)
 #define LOG_REACTION (1 << 9)
 #define LOG_DISCOVER (1 << 10)
+#define LOG_PILE (1 << 11)
 
 #define LOG_ALL (~0)
 
@@ -1,4 +1,5 @@
 #include "grok.h"
+#include "grok_number.h"
 
 const grok_capture *grok_match_get_named_capture(const grok_match_t *gm,
                                                  const char *name) {
@@ -36,6 +37,34 @@ int grok_match_get_named_substring(const grok_match_t *gm, const char *name,
   return 0;
 }
 
+int grok_match_get_named_long(const grok_match_t *gm, const char *name,
+                              long *value) {
+  const char *substr;
+  int len;
+
+  if (grok_match_get_named_substring(gm, name, &substr, &len) != 0) {
+    return -1;
+  }
+  if (len == 0 || grok_parse_long(substr, len, 10, value) != len) {
+    return -2;
+  }
+  return 0;
+}
+
+int grok_match_get_named_double(const grok_match_t *gm, const char *name,
+                                double *value) {
+  const char *substr;
+  int len;
+
+  if (grok_match_get_named_substring(gm, name, &substr, &len) != 0) {
+    return -1;
+  }
+  if (len == 0 || grok_parse_double(substr, len, value) != len) {
+    return -2;
+  }
+  return 0;
+}
+
 void grok_match_walk_init(grok_match_t *gm) {
   const grok_t *grok = gm->grok;
   gm->iter = grok_capture_walk_init(grok);
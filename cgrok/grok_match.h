@@ -37,6 +37,18 @@ const grok_capture * grok_match_get_named_capture(const grok_match_t *gm,
 int grok_match_get_named_substring(const grok_match_t *gm, const char *name,
                                    const char **substr, int *len);
 
+/**
+ * Convert a named capture to a number with grok_parse_long(), in base 10,
+ * or grok_parse_double().
+ *
+ * @returns 0 on success, -1 if there's no such capture, -2 if it didn't
+ *          capture anything or isn't entirely a number.
+ */
+int grok_match_get_named_long(const grok_match_t *gm, const char *name,
+                              long *value);
+int grok_match_get_named_double(const grok_match_t *gm, const char *name,
+                                double *value);
+
 void grok_match_walk_init(grok_match_t *gm);
 int grok_match_walk_next(grok_match_t *gm,
                          char **name, int *namelen,
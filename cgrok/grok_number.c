@@ -0,0 +1,228 @@
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "grok_number.h"
+
+/* Mantissas with more significant digits than this, or exponents beyond
+ * what the power table covers, go to strtod for correct rounding */
+#define EXACT_DIGITS 19
+#define EXACT_POW10 22
+
+/* Longest number we'll copy for the strtod fallback */
+#define FALLBACK_MAX 64
+
+static const double pow10_table[EXACT_POW10 + 1] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static int hex_digit(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+/* The characters isspace() accepts in the C locale */
+static int is_space(char c) {
+  return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+static int skip_space_and_sign(const char *text, int len, int *negative) {
+  int i = 0;
+  while (i < len && is_space(text[i])) {
+    i++;
+  }
+  *negative = 0;
+  if (i < len && (text[i] == '-' || text[i] == '+')) {
+    *negative = (text[i] == '-');
+    i++;
+  }
+  return i;
+}
+
+/* Copy text to a NUL terminated buffer and parse it with strtod */
+static int strtod_bounded(const char *text, int len, double *value) {
+  char buf[FALLBACK_MAX];
+  char *end;
+  int n = (len < FALLBACK_MAX - 1) ? len : FALLBACK_MAX - 1;
+
+  memcpy(buf, text, n);
+  buf[n] = '\0';
+  *value = strtod(buf, &end);
+  return end - buf;
+}
+
+int grok_parse_long(const char *text, int len, int base, long *value) {
+  int negative;
+  int i = skip_space_and_sign(text, len, &negative);
+  int start;
+  unsigned long limit = negative ? (unsigned long)LONG_MAX + 1 : LONG_MAX;
+  unsigned long n = 0;
+  int overflow = 0;
+
+  /* A 0x with no hex digit after it is just a zero, as with strtol */
+  if ((base == 0 || base == 16) && i + 2 < len && text[i] == '0'
+      && (text[i + 1] == 'x' || text[i + 1] == 'X')
+      && hex_digit(text[i + 2]) >= 0) {
+    base = 16;
+    i += 2;
+  } else if (base == 0) {
+    base = (i < len && text[i] == '0') ? 8 : 10;
+  }
+
+  start = i;
+  for (; i < len; i++) {
+    int digit = hex_digit(text[i]);
+    if (digit < 0 || digit >= base) {
+      break;
+    }
+    if (n > (limit - digit) / base) {
+      overflow = 1;
+    } else {
+      n = n * base + digit;
+    }
+  }
+
+  if (i == start) {
+    *value = 0;
+    return 0;
+  }
+  if (overflow) {
+    *value = negative ? LONG_MIN : LONG_MAX;
+  } else if (negative) {
+    *value = (n == (unsigned long)LONG_MAX + 1) ? LONG_MIN : -(long)n;
+  } else {
+    *value = (long)n;
+  }
+  return i;
+}
+
+int grok_parse_double(const char *text, int len, double *value) {
+  int negative;
+  int i = skip_space_and_sign(text, len, &negative);
+  int number_start = i;
+  unsigned long long mantissa = 0;
+  int digits = 0;      /* significant digits in mantissa */
+  int dropped = 0;     /* integer digits that didn't fit in mantissa */
+  int scale = 0;       /* fraction digits kept in mantissa */
+  int seen_digit = 0;
+  int exponent = 0;
+  double result;
+
+  if (i < len && (text[i] == 'i' || text[i] == 'I' || text[i] == 'n'
+                  || text[i] == 'N'
+                  || (text[i] == '0' && i + 1 < len
+                      && (text[i + 1] == 'x' || text[i + 1] == 'X')))) {
+    return strtod_bounded(text, len, value);
+  }
+
+  for (; i < len && text[i] >= '0' && text[i] <= '9'; i++) {
+    seen_digit = 1;
+    if (mantissa == 0 && text[i] == '0') {
+      continue;
+    }
+    if (digits < EXACT_DIGITS) {
+      mantissa = mantissa * 10 + (text[i] - '0');
+      digits++;
+    } else {
+      dropped++;
+    }
+  }
+  if (i < len && text[i] == '.') {
+    i++;
+    for (; i < len && text[i] >= '0' && text[i] <= '9'; i++) {
+      seen_digit = 1;
+      if (mantissa == 0 && text[i] == '0') {
+        scale++;
+        continue;
+      }
+      if (digits < EXACT_DIGITS) {
+        mantissa = mantissa * 10 + (text[i] - '0');
+        digits++;
+        scale++;
+      } else {
+        dropped = -1; /* significant digits lost; round with strtod */
+      }
+    }
+  }
+  if (!seen_digit) {
+    *value = 0;
+    return 0;
+  }
+
+  /* Exponent, only if it's well formed */
+  if (i < len && (text[i] == 'e' || text[i] == 'E')) {
+    int j = i + 1;
+    int exp_negative = 0;
+    int e = 0;
+    if (j < len && (text[j] == '-' || text[j] == '+')) {
+      exp_negative = (text[j] == '-');
+      j++;
+    }
+    if (j < len && text[j] >= '0' && text[j] <= '9') {
+      for (; j < len && text[j] >= '0' && text[j] <= '9'; j++) {
+        if (e < 10000) {
+          e = e * 10 + (text[j] - '0');
+        }
+      }
+      exponent = exp_negative ? -e : e;
+      i = j;
+    }
+  }
+
+  exponent += (dropped > 0 ? dropped : 0) - scale;
+  if (dropped >= 0 && mantissa < (1ULL << 53)
+      && exponent >= -EXACT_POW10 && exponent <= EXACT_POW10) {
+    /* Both the mantissa and the power of ten are exact doubles, so one
+     * multiply or divide rounds correctly */
+    result = (double)mantissa;
+    if (exponent < 0) {
+      result /= pow10_table[-exponent];
+    } else {
+      result *= pow10_table[exponent];
+    }
+  } else if (mantissa == 0) {
+    result = 0.0;
+  } else if (i - number_start < FALLBACK_MAX) {
+    strtod_bounded(text + number_start, i - number_start, &result);
+  } else {
+    /* Absurdly long; good to about 19 significant digits */
+    result = (double)mantissa;
+    for (; exponent > 0; exponent--) result *= 10;
+    for (; exponent < 0; exponent++) result /= 10;
+  }
+
+  *value = negative ? -result : result;
+  return i;
+}
+
+int grok_parse_ipv4(const char *text, int len, uint32_t *addr) {
+  uint32_t result = 0;
+  int pos = 0;
+  int part;
+
+  for (part = 0; part < 4; part++) {
+    int octet = 0;
+    int digits = 0;
+    if (part > 0) {
+      if (pos >= len || text[pos] != '.') {
+        return 0;
+      }
+      pos++;
+    }
+    while (pos < len && digits < 3 && text[pos] >= '0' && text[pos] <= '9') {
+      octet = octet * 10 + (text[pos] - '0');
+      digits++;
+      pos++;
+    }
+    if (digits == 0 || octet > 255) {
+      return 0;
+    }
+    result = (result << 8) | octet;
+  }
+
+  *addr = result;
+  return pos;
+}
@@ -0,0 +1,46 @@
+/**
+ * @file grok_number.h
+ */
+#ifndef _GROK_NUMBER_H_
+#define _GROK_NUMBER_H_
+#include <stdint.h>
+
+/*
+ * Length-bounded number parsers for captured text. Unlike strtol and
+ * strtod they never read past text + len, don't need a NUL terminator,
+ * don't allocate and don't depend on the locale.
+ */
+
+/**
+ * Parse an integer as strtol does: optional leading whitespace, an optional
+ * sign, then digits in base. Base 0 means hex after a 0x, octal after a
+ * leading 0, and decimal otherwise; base 16 also allows a 0x prefix. Values
+ * out of range saturate to LONG_MIN or LONG_MAX.
+ *
+ * @param base 2 to 16, or 0.
+ * @returns the number of bytes parsed, or 0 if text doesn't start with an
+ *          integer (and *value is set to 0).
+ */
+int grok_parse_long(const char *text, int len, int base, long *value);
+
+/**
+ * Parse a number as strtod does: optional leading whitespace, an optional
+ * sign, digits with an optional fraction, and an optional exponent. Hex
+ * numbers, infinities and NaNs are rarer, so they're copied and handed to
+ * strtod.
+ *
+ * @returns the number of bytes parsed, or 0 if text doesn't start with a
+ *          number (and *value is set to 0).
+ */
+int grok_parse_double(const char *text, int len, double *value);
+
+/**
+ * Parse a dotted-quad IPv4 address, like 10.0.0.1, into a host-order
+ * integer. Each part is one to three decimal digits, at most 255.
+ *
+ * @returns the number of bytes parsed, or 0 if text doesn't start with an
+ *          address.
+ */
+int grok_parse_ipv4(const char *text, int len, uint32_t *addr);
+
+#endif /* _GROK_NUMBER_H_ */
@@ -0,0 +1,924 @@
+#include <ctype.h>
+
+#include "grok.h"
+#include "stringhelper.h"
+
+/* PCRE with LINK_SIZE 2 refuses compiled patterns over 64K, so stop adding
+ * members to a chunk once their compiled sizes add up to about this much. */
+#define PILE_CHUNK_BUDGET 49152
+
+/* Literals shorter than this are too common to be worth indexing, and a
+ * few of the longest literals are enough to rule most members out */
+#define PILE_LITERAL_MIN_LEN 2
+#define PILE_LITERALS_PER_MEMBER 4
+
+static int grok_pile_member_combinable(const grok_pile_t *pile,
+                                       const grok_t *member);
+static void grok_pile_build_chunks(grok_pile_t *pile, int first, int count);
+static int grok_pile_compile_chunk(grok_pile_t *pile, grok_pile_chunk_t *chunk);
+static void grok_pile_clear_chunks(grok_pile_t *pile);
+static void grok_pile_build_literals(grok_pile_t *pile);
+static void grok_pile_build_order(grok_pile_t *pile);
+static void grok_pile_build_dispatch(grok_pile_t *pile);
+static void grok_pile_build_swappable(grok_pile_t *pile);
+static void grok_pile_member_start_bits(grok_pile_member_t *member);
+static char *grok_pile_strip_word_boundaries(const char *pattern);
+static int grok_pile_shape_member(const grok_pile_t *pile, uint64_t shape,
+                                  const uint64_t *candidates);
+static int grok_pile_candidates(const grok_pile_t *pile, const char *text,
+                                int textlen, uint64_t *candidates);
+
+grok_pile_t *grok_pile_new() {
+  grok_pile_t *pile = malloc(sizeof(grok_pile_t));
+  grok_pile_init(pile);
+  return pile;
+}
+
+void grok_pile_init(grok_pile_t *pile) {
+  grok_init(&pile->library);
+  pile->members = NULL;
+  pile->nmembers = 0;
+  pile->members_size = 0;
+  pile->order = NULL;
+  pile->swappable = NULL;
+  pile->chunks = NULL;
+  pile->nchunks = 0;
+  grok_literal_index_init(&pile->literals);
+  pile->member_literals = NULL;
+  pile->member_literal_start = NULL;
+  pile->dispatch = NULL;
+  pile->shapes = calloc(1, sizeof(grok_pile_shape_cache_t));
+  pile->ninsensitive = 0;
+  pile->logmask = 0;
+  pile->logdepth = 0;
+  pile->errstr = NULL;
+}
+
+void grok_pile_clean(grok_pile_t *pile) {
+  int i;
+
+  for (i = 0; i < pile->nmembers; i++) {
+    if (pile->members[i].owned) {
+      grok_t *member = (grok_t *)pile->members[i].grok;
+      free((char *)member->pattern);
+      grok_free_clone(member);
+      free(member);
+    }
+  }
+  grok_pile_clear_chunks(pile);
+  grok_literal_index_clean(&pile->literals);
+  free(pile->member_literals);
+  free(pile->member_literal_start);
+  pile->member_literals = NULL;
+  pile->member_literal_start = NULL;
+  free(pile->dispatch);
+  pile->dispatch = NULL;
+  free(pile->shapes);
+  pile->shapes = NULL;
+  free(pile->members);
+  free(pile->order);
+  free(pile->swappable);
+  pile->members = NULL;
+  pile->order = NULL;
+  pile->swappable = NULL;
+  pile->nmembers = 0;
+  pile->members_size = 0;
+  pile->ninsensitive = 0;
+
+  grok_free_clone(&pile->library);
+  tctreedel(pile->library.patterns);
+  pile->library.patterns = NULL;
+}
+
+void grok_pile_free(grok_pile_t *pile) {
+  grok_pile_clean(pile);
+  free(pile);
+}
+
+int grok_pile_add(grok_pile_t *pile, const grok_t *member) {
+  return grok_pile_add_flags(pile, member, 0);
+}
+
+int grok_pile_add_flags(grok_pile_t *pile, const grok_t *member, int flags) {
+  grok_pile_member_t *m;
+
+  if (member->re == NULL) {
+    grok_log(pile, LOG_PILE, "Refusing to add a grok with no compiled pattern");
+    return GROK_ERROR_UNINITIALIZED;
+  }
+
+  if (pile->nmembers == pile->members_size) {
+    pile->members_size = (pile->members_size == 0) ? 8 : pile->members_size * 2;
+    pile->members = realloc(pile->members,
+                            pile->members_size * sizeof(grok_pile_member_t));
+    pile->order = realloc(pile->order, pile->members_size * sizeof(int));
+  }
+
+  /* New members have the lowest priority, so they go last */
+  m = pile->members + pile->nmembers;
+  m->grok = member;
+  m->flags = flags;
+  m->owned = 0;
+  m->position = pile->nmembers;
+  m->hits = 0;
+  m->misses = 0;
+  grok_pile_member_start_bits(m);
+  pile->order[pile->nmembers] = pile->nmembers;
+  pile->nmembers++;
+  if (flags & GROK_PILE_ORDER_INSENSITIVE) {
+    pile->ninsensitive++;
+  }
+
+  /* The swappable matrix, dispatch table and literal lists are all sized by
+   * member, so they're out of date until the next grok_pile_compile() */
+  free(pile->swappable);
+  pile->swappable = NULL;
+  free(pile->dispatch);
+  pile->dispatch = NULL;
+  free(pile->member_literals);
+  free(pile->member_literal_start);
+  pile->member_literals = NULL;
+  pile->member_literal_start = NULL;
+  grok_log(pile, LOG_PILE, "Added member %d: %.*s", pile->nmembers - 1,
+           member->pattern_len, member->pattern);
+  return GROK_OK;
+}
+
+int grok_pile_add_pattern(grok_pile_t *pile, const char *pattern, int length,
+                          int only_renamed, int flags) {
+  grok_t *member = malloc(sizeof(grok_t));
+  char *copy = malloc(length + 1);
+  int ret;
+
+  memcpy(copy, pattern, length);
+  copy[length] = '\0';
+
+  /* Clones share the library's patterns rather than copying them */
+  grok_clone(member, &pile->library);
+  ret = grok_compilen(member, copy, length, only_renamed);
+  if (ret == GROK_OK) {
+    ret = grok_pile_add_flags(pile, member, flags);
+  }
+  if (ret != GROK_OK) {
+    pile->errstr = member->errstr;
+    grok_free_clone(member);
+    free(member);
+    free(copy);
+    return ret;
+  }
+
+  pile->members[pile->nmembers - 1].owned = 1;
+  return GROK_OK;
+}
+
+const grok_t *grok_pile_member(const grok_pile_t *pile, int member) {
+  return pile->members[member].grok;
+}
+
+int grok_pile_compile(grok_pile_t *pile) {
+  grok_pile_build_swappable(pile);
+  grok_pile_build_order(pile);
+  grok_pile_build_literals(pile);
+  grok_pile_build_dispatch(pile);
+
+  grok_log(pile, LOG_PILE, "Compiled %d members into %d chunks, %d literals",
+           pile->nmembers, pile->nchunks, pile->literals.nliterals);
+  return GROK_OK;
+}
+
+int grok_pile_reorder(grok_pile_t *pile) {
+  int *order, pos, i, k;
+  unsigned char *placed;
+  int changed = 0;
+
+  if (pile->swappable == NULL) {
+    /* not compiled since the last member was added */
+    return 0;
+  }
+  order = malloc((pile->nmembers + 1) * sizeof(int));
+  placed = calloc(pile->nmembers + 1, 1);
+
+  /* Greedily take the most frequently matching member that no unplaced
+   * higher priority member has to precede. For every pair that isn't
+   * swappable, the higher priority member is placed first, so the first
+   * member to match a line is the same as in priority order. */
+  for (pos = 0; pos < pile->nmembers; pos++) {
+    int best = -1;
+    uint64_t best_hits = 0;
+
+    for (i = 0; i < pile->nmembers; i++) {
+      uint64_t hits;
+      if (placed[i]) {
+        continue;
+      }
+      for (k = 0; k < i; k++) {
+        if (!placed[k] && !pile->swappable[k * pile->nmembers + i]) {
+          break;
+        }
+      }
+      if (k < i) {
+        continue;
+      }
+      hits = __atomic_load_n(&pile->members[i].hits, __ATOMIC_RELAXED);
+      if (best < 0 || hits > best_hits) {
+        best = i;
+        best_hits = hits;
+      }
+    }
+
+    /* The lowest unplaced member is always eligible, so best is set */
+    order[pos] = best;
+    placed[best] = 1;
+    if (order[pos] != pile->order[pos]) {
+      changed = 1;
+    }
+  }
+  free(placed);
+
+  if (!changed) {
+    free(order);
+    return 0;
+  }
+
+  free(pile->order);
+  pile->order = order;
+  grok_pile_build_order(pile);
+
+  /* Cached members were first to match in the old order; in the new one,
+   * a member they're swappable with may come first */
+  memset(pile->shapes->entries, 0, sizeof(pile->shapes->entries));
+  grok_log(pile, LOG_PILE, "Reordered members, member %d now goes first",
+           pile->order[0]);
+  return 1;
+}
+
+int grok_pile_member_stats(const grok_pile_t *pile, int member,
+                           uint64_t *hits, uint64_t *misses, int *position) {
+  if (member < 0 || member >= pile->nmembers) {
+    return GROK_ERROR_UNINITIALIZED;
+  }
+  *hits = __atomic_load_n(&pile->members[member].hits, __ATOMIC_RELAXED);
+  *misses = __atomic_load_n(&pile->members[member].misses, __ATOMIC_RELAXED);
+  *position = pile->members[member].position;
+  return GROK_OK;
+}
+
+void grok_pile_shape_stats(const grok_pile_t *pile, uint64_t *hits,
+                           uint64_t *misses) {
+  *hits = __atomic_load_n(&pile->shapes->hits, __ATOMIC_RELAXED);
+  *misses = __atomic_load_n(&pile->shapes->misses, __ATOMIC_RELAXED);
+}
+
+/* Record positions for the current order and build its chunks */
+static void grok_pile_build_order(grok_pile_t *pile) {
+  int i = 0;
+
+  grok_pile_clear_chunks(pile);
+  for (i = 0; i < pile->nmembers; i++) {
+    pile->members[pile->order[i]].position = i;
+  }
+
+  i = 0;
+
+  /* Members that can't be combined get a chunk of their own; runs of
+   * members between them are combined, split up to fit PCRE's size limit */
+  while (i < pile->nmembers) {
+    int first = i;
+    size_t budget = 0;
+
+    while (i < pile->nmembers
+           && grok_pile_member_combinable(pile,
+                                          pile->members[pile->order[i]].grok)) {
+      size_t size = 0;
+      pcre_fullinfo(pile->members[pile->order[i]].grok->re, NULL,
+                    PCRE_INFO_SIZE, &size);
+      if (i > first && budget + size > PILE_CHUNK_BUDGET) {
+        break;
+      }
+      budget += size;
+      i++;
+    }
+
+    if (i == first) {
+      /* not combinable, run it alone */
+      grok_pile_build_chunks(pile, first, 1);
+      i++;
+    } else {
+      grok_pile_build_chunks(pile, first, i - first);
+    }
+  }
+}
+
+int grok_pile_execn(const grok_pile_t *pile, const char *text, int textlen,
+                    int *member, grok_match_t *gm) {
+  int c, pos, covered;
+  int all_candidates;
+  int matched_pos = pile->nmembers;
+  int cached = -1, missed = -1;
+  uint64_t shape = 0;
+  uint64_t candidates[GROK_BITSET_WORDS(pile->nmembers) + 1];
+
+  all_candidates = grok_pile_candidates(pile, text, textlen, candidates);
+
+  /* Lines of one shape are usually in one format, so try the member that
+   * last matched this shape first. Only order-insensitive members can be
+   * tried out of order, so other piles don't pay for the fingerprint. */
+  if (pile->ninsensitive > 0) {
+    shape = grok_shape_fingerprint(text, textlen);
+    cached = grok_pile_shape_member(pile, shape, candidates);
+  }
+  if (cached >= 0) {
+    if (grok_execn(pile->members[cached].grok, text, textlen, gm) == GROK_OK) {
+      __atomic_fetch_add(&pile->shapes->hits, 1, __ATOMIC_RELAXED);
+      /* Count misses for what the full evaluation would have tried first,
+       * so grok_pile_reorder() sees the same counters either way */
+      for (pos = 0; pos < pile->members[cached].position; pos++) {
+        __atomic_fetch_add(&pile->members[pile->order[pos]].misses, 1,
+                           __ATOMIC_RELAXED);
+      }
+      __atomic_fetch_add(&pile->members[cached].hits, 1, __ATOMIC_RELAXED);
+      *member = cached;
+      return GROK_OK;
+    }
+    /* The combined chunk is still worth running: the member's branch just
+     * won't match again. Only the one-at-a-time runs skip it. */
+    __atomic_fetch_add(&pile->shapes->misses, 1, __ATOMIC_RELAXED);
+    missed = cached;
+  }
+
+  for (c = 0; c < pile->nchunks && matched_pos == pile->nmembers; c++) {
+    const grok_pile_chunk_t *chunk = pile->chunks + c;
+    const grok_t *matched;
+    int *ovector;
+    int ret, i, k, lo, hi;
+    int run_combined = (chunk->re != NULL);
+
+    if (run_combined && !all_candidates) {
+      for (pos = chunk->first; pos < chunk->first + chunk->count; pos++) {
+        if (!GROK_BITSET_TEST(candidates, pile->order[pos])) {
+          run_combined = 0;
+          break;
+        }
+      }
+    }
+
+    if (run_combined) {
+      ovector = malloc(chunk->num_captures * 3 * sizeof(int));
+      ret = pcre_exec(chunk->re, chunk->re_extra, text, textlen, 0, 0,
+                      ovector, chunk->num_captures * 3);
+      grok_log(pile, LOG_PILE, "chunk %d (positions %d-%d) => %d", c,
+               chunk->first, chunk->first + chunk->count - 1, ret);
+      if (ret == PCRE_ERROR_NOMATCH || ret == 1) {
+        /* No match, or no tag group set (which shouldn't happen) */
+        free(ovector);
+        continue;
+      }
+      if (ret <= 0) {
+        /* Hitting a match or recursion limit on the combined regexp says
+         * nothing about whether a member matches on its own */
+        grok_log(pile, LOG_PILE, "chunk %d failed with PCRE error %d, "
+                 "trying its members one at a time", c, ret);
+        free(ovector);
+        run_combined = 0;
+      }
+    }
+
+    if (!run_combined) {
+      /* Run the chunk's remaining candidates one at a time */
+      for (pos = chunk->first; pos < chunk->first + chunk->count; pos++) {
+        if (!GROK_BITSET_TEST(candidates, pile->order[pos])
+            || pile->order[pos] == missed) {
+          continue;
+        }
+        ret = grok_execn(pile->members[pile->order[pos]].grok, text, textlen,
+                         gm);
+        if (ret == GROK_OK) {
+          matched_pos = pos;
+          break;
+        }
+      }
+      continue;
+    }
+
+    /* The highest capture set belongs to the branch that matched; find
+     * the last tag at or below it. */
+    lo = 0;
+    hi = chunk->count - 1;
+    while (lo < hi) {
+      int mid = (lo + hi + 1) / 2;
+      if (chunk->tags[mid] <= ret - 1) {
+        lo = mid;
+      } else {
+        hi = mid - 1;
+      }
+    }
+    i = lo;
+    matched = pile->members[pile->order[chunk->first + i]].grok;
+
+    if (gm != NULL) {
+      /* Remap the chunk's capture numbers onto the member's */
+      int *vector = calloc(matched->pcre_num_captures * 3, sizeof(int));
+      for (k = 0; k < matched->pcre_num_captures; k++) {
+        int n = chunk->tags[i] + k;
+        if (n < ret) {
+          vector[k * 2] = ovector[n * 2];
+          vector[k * 2 + 1] = ovector[n * 2 + 1];
+        } else {
+          vector[k * 2] = -1;
+          vector[k * 2 + 1] = -1;
+        }
+      }
+      gm->grok = matched;
+      gm->subject = text;
+      gm->pcre_capture_vector = vector;
+      gm->start = vector[0];
+      gm->end = vector[1];
+    }
+
+    free(ovector);
+    matched_pos = chunk->first + i;
+  }
+
+  /* Members added since the last grok_pile_compile() aren't in a chunk yet.
+   * They have the lowest priority and come last in the order, so try them
+   * one at a time after everything else. */
+  covered = (pile->nchunks > 0)
+            ? pile->chunks[pile->nchunks - 1].first
+              + pile->chunks[pile->nchunks - 1].count
+            : 0;
+  for (pos = covered; pos < pile->nmembers && matched_pos == pile->nmembers;
+       pos++) {
+    if (pile->order[pos] != missed && grok_execn(pile->members[pile->order[pos]].grok, text, textlen,
+                   gm) == GROK_OK) {
+      matched_pos = pos;
+    }
+  }
+
+  /* Everything tried before the match missed */
+  for (pos = 0; pos < matched_pos; pos++) {
+    __atomic_fetch_add(&pile->members[pile->order[pos]].misses, 1,
+                       __ATOMIC_RELAXED);
+  }
+  if (matched_pos == pile->nmembers) {
+    return GROK_ERROR_NOMATCH;
+  }
+
+  *member = pile->order[matched_pos];
+  __atomic_fetch_add(&pile->members[*member].hits, 1, __ATOMIC_RELAXED);
+  if ((pile->members[*member].flags & GROK_PILE_ORDER_INSENSITIVE)
+      && *member < 0xffff) {
+    __atomic_store_n(pile->shapes->entries
+                     + (shape & (GROK_PILE_SHAPE_CACHE_SIZE - 1)),
+                     (shape & ~(uint64_t)0xffff) | (*member + 1),
+                     __ATOMIC_RELAXED);
+  }
+  return GROK_OK;
+}
+
+/* The member cached for this line shape, if it can be tried first: it's
+ * still a candidate, and every candidate ahead of it in the evaluation
+ * order is swappable with it. Since two candidates for a line can't have
+ * disjoint start bits, that means they're all order-insensitive. A candidate that isn't might match the line
+ * too and would have to win, so the cache is skipped and the full
+ * evaluation runs; neither counts as a cache hit or miss. Otherwise -1. */
+static int grok_pile_shape_member(const grok_pile_t *pile, uint64_t shape,
+                                  const uint64_t *candidates) {
+  uint64_t entry = __atomic_load_n(
+    pile->shapes->entries + (shape & (GROK_PILE_SHAPE_CACHE_SIZE - 1)),
+    __ATOMIC_RELAXED);
+  int cached, pos;
+
+  if (entry == 0 || (entry >> 16) != (shape >> 16)) {
+    return -1;
+  }
+  cached = (int)(entry & 0xffff) - 1;
+  if (cached >= pile->nmembers || pile->swappable == NULL
+      || !GROK_BITSET_TEST(candidates, cached)) {
+    return -1;
+  }
+
+  for (pos = 0; pos < pile->members[cached].position; pos++) {
+    int other = pile->order[pos];
+    if (GROK_BITSET_TEST(candidates, other)
+        && !pile->swappable[other * pile->nmembers + cached]) {
+      return -1;
+    }
+  }
+  return cached;
+}
+
+/* Set a bit in candidates for each member that could match text: one
+ * whose start bits allow text's first byte and whose required literals all
+ * appear in it. Returns 1 if every member is a candidate. */
+static int grok_pile_candidates(const grok_pile_t *pile, const char *text,
+                                int textlen, uint64_t *candidates) {
+  int i, l;
+  int all = 1;
+  int words = GROK_BITSET_WORDS(pile->nmembers);
+  uint64_t seen[GROK_BITSET_WORDS(pile->literals.nliterals) + 1];
+
+  if (pile->dispatch == NULL) {
+    memset(candidates, 0xff, words * sizeof(uint64_t));
+    return 1;
+  }
+
+  memcpy(candidates,
+         pile->dispatch + ((textlen > 0) ? (unsigned char)text[0] : 256) * words,
+         words * sizeof(uint64_t));
+
+  if (pile->literals.nliterals > 0) {
+    memset(seen, 0, sizeof(seen));
+    grok_literal_index_scan(&pile->literals, text, textlen, seen);
+  }
+
+  for (i = 0; i < pile->nmembers; i++) {
+    if (!GROK_BITSET_TEST(candidates, i)) {
+      all = 0;
+      continue;
+    }
+    for (l = pile->member_literal_start[i];
+         l < pile->member_literal_start[i + 1]; l++) {
+      if (!GROK_BITSET_TEST(seen, pile->member_literals[l])) {
+        GROK_BITSET_CLEAR(candidates, i);
+        all = 0;
+        break;
+      }
+    }
+  }
+
+  grok_log(pile, LOG_PILE, "Prefilter: %s", all ? "all members" : "some members");
+  return all;
+}
+
+/* A member can match a line starting with any byte in its start bits;
+ * members without start bits can match any line. */
+static void grok_pile_build_dispatch(grok_pile_t *pile) {
+  int i, b;
+  int words = GROK_BITSET_WORDS(pile->nmembers);
+
+  free(pile->dispatch);
+  pile->dispatch = calloc(257 * words + 1, sizeof(uint64_t));
+
+  for (i = 0; i < pile->nmembers; i++) {
+    const grok_pile_member_t *member = pile->members + i;
+    for (b = 0; b < 256; b++) {
+      if (!member->has_start_bits
+          || (member->start_bits[b / 8] & (1 << (b % 8)))) {
+        GROK_BITSET_SET(pile->dispatch + b * words, i);
+      }
+    }
+    /* start bits mean a match has at least one byte */
+    if (!member->has_start_bits) {
+      GROK_BITSET_SET(pile->dispatch + 256 * words, i);
+    }
+  }
+}
+
+static void grok_pile_build_literals(grok_pile_t *pile) {
+  int i, l;
+  int nliterals = 0;
+
+  grok_literal_index_clean(&pile->literals);
+  grok_literal_index_init(&pile->literals);
+  free(pile->member_literals);
+  free(pile->member_literal_start);
+
+  pile->member_literals = malloc((pile->nmembers * PILE_LITERALS_PER_MEMBER + 1)
+                                 * sizeof(int));
+  pile->member_literal_start = malloc((pile->nmembers + 1) * sizeof(int));
+
+  for (i = 0; i < pile->nmembers; i++) {
+    const grok_t *member = pile->members[i].grok;
+    TCLIST *found = tclistnew();
+    int count = grok_literal_extract(member->full_pattern,
+                                     member->full_pattern_len,
+                                     PILE_LITERAL_MIN_LEN, found);
+
+    pile->member_literal_start[i] = nliterals;
+    /* Keep the longest few; they are the most selective */
+    for (l = 0; l < PILE_LITERALS_PER_MEMBER && l < count; l++) {
+      int j, best = -1, best_len = 0, size;
+      const char *best_literal = NULL;
+      for (j = 0; j < tclistnum(found); j++) {
+        const char *literal = tclistval(found, j, &size);
+        if (size > best_len) {
+          best = j;
+          best_len = size;
+          best_literal = literal;
+        }
+      }
+      pile->member_literals[nliterals++] =
+        grok_literal_index_add(&pile->literals, best_literal, best_len);
+      grok_log(pile, LOG_PILE, "Member %d requires literal '%.*s'", i,
+               best_len, best_literal);
+      free(tclistremove(found, best, &size));
+    }
+    tclistdel(found);
+  }
+  pile->member_literal_start[pile->nmembers] = nliterals;
+
+  grok_literal_index_build(&pile->literals);
+}
+
+/* A member can be combined with others only if its regexp doesn't depend
+ * on absolute group numbers or names, and nothing in it can swallow the
+ * text we wrap it with. */
+static int grok_pile_member_combinable(const grok_pile_t *pile,
+                                       const grok_t *member) {
+  const char *p = member->full_pattern;
+  const char *end = member->full_pattern + member->full_pattern_len;
+  int backrefmax = 0;
+
+  /* Predicate callouts need the member's own callout data */
+  if (member->npredicates > 0) {
+    grok_log(pile, LOG_PILE, "Not combining '%.*s': has predicates",
+             member->pattern_len, member->pattern);
+    return 0;
+  }
+
+  pcre_fullinfo(member->re, NULL, PCRE_INFO_BACKREFMAX, &backrefmax);
+  if (backrefmax > 0) {
+    grok_log(pile, LOG_PILE, "Not combining '%.*s': uses backreferences",
+             member->pattern_len, member->pattern);
+    return 0;
+  }
+
+  for (; p < end; p++) {
+    if (*p == '\\' && p + 1 < end) {
+      p++;
+      if (*p == 'g' || *p == 'k') {
+        break;
+      }
+      continue;
+    }
+    if (*p == '(' && p + 2 < end && p[1] == '?') {
+      const char *opt = p + 2;
+      if (*opt == 'R' || *opt == '&' || (*opt >= '0' && *opt <= '9')
+          || (*opt == 'P' && opt + 1 < end && opt[1] == '>')) {
+        break; /* recursion or subroutine call */
+      }
+      while (opt < end && (isalpha(*opt) || *opt == '-') && *opt != 'x') {
+        opt++;
+      }
+      if (opt < end && *opt == 'x') {
+        break; /* extended mode comments could eat our closing parens */
+      }
+    }
+  }
+
+  if (p < end) {
+    grok_log(pile, LOG_PILE, "Not combining '%.*s': uses recursion, "
+             "named references or extended mode",
+             member->pattern_len, member->pattern);
+    return 0;
+  }
+  return 1;
+}
+
+/* Compile the members at positions [first, first + count) into chunks, halving the run until
+ * each piece compiles. */
+static void grok_pile_build_chunks(grok_pile_t *pile, int first, int count) {
+  grok_pile_chunk_t chunk;
+
+  chunk.first = first;
+  chunk.count = count;
+  chunk.re = NULL;
+  chunk.re_extra = NULL;
+  chunk.num_captures = 0;
+  chunk.tags = NULL;
+
+  if (count > 1 && grok_pile_compile_chunk(pile, &chunk) != GROK_OK) {
+    grok_pile_build_chunks(pile, first, count / 2);
+    grok_pile_build_chunks(pile, first + count / 2, count - count / 2);
+    return;
+  }
+
+  pile->chunks = realloc(pile->chunks,
+                         (pile->nchunks + 1) * sizeof(grok_pile_chunk_t));
+  pile->chunks[pile->nchunks++] = chunk;
+}
+
+static int grok_pile_compile_chunk(grok_pile_t *pile, grok_pile_chunk_t *chunk) {
+  char *pattern = NULL;
+  int pattern_len = 0;
+  int pattern_size = 0;
+  const char *errptr = NULL;
+  int erroffset = 0;
+  int capture_count = 0;
+  int next_tag = 1;
+  int i;
+
+  chunk->tags = malloc(chunk->count * sizeof(int));
+  substr_replace(&pattern, &pattern_len, &pattern_size, 0, 0, "(?:", 3);
+  for (i = 0; i < chunk->count; i++) {
+    const grok_t *member = pile->members[pile->order[chunk->first + i]].grok;
+    unsigned long options = 0;
+
+    pcre_fullinfo(member->re, NULL, PCRE_INFO_OPTIONS, &options);
+    if (i > 0) {
+      substr_replace(&pattern, &pattern_len, &pattern_size,
+                     pattern_len, pattern_len, "|", 1);
+    }
+
+    /* Anchored members can only match at 0, no need to scan for them */
+    if (options & PCRE_ANCHORED) {
+      substr_replace(&pattern, &pattern_len, &pattern_size,
+                     pattern_len, pattern_len, "(?=(", 4);
+    } else {
+      substr_replace(&pattern, &pattern_len, &pattern_size,
+                     pattern_len, pattern_len, "(?=[\\s\\S]*?(", 12);
+    }
+    substr_replace(&pattern, &pattern_len, &pattern_size,
+                   pattern_len, pattern_len,
+                   member->full_pattern, member->full_pattern_len);
+    /* \E is a no-op unless the member left a \Q open */
+    substr_replace(&pattern, &pattern_len, &pattern_size,
+                   pattern_len, pattern_len, "\\E))", 4);
+
+    chunk->tags[i] = next_tag;
+    next_tag += member->pcre_num_captures;
+  }
+  substr_replace(&pattern, &pattern_len, &pattern_size,
+                 pattern_len, pattern_len, ")", 1);
+
+  chunk->re = pcre_compile(pattern, PCRE_ANCHORED | PCRE_DUPNAMES,
+                           &errptr, &erroffset, NULL);
+  if (chunk->re != NULL) {
+    pcre_fullinfo(chunk->re, NULL, PCRE_INFO_CAPTURECOUNT, &capture_count);
+  }
+  if (chunk->re == NULL || capture_count + 1 != next_tag) {
+    grok_log(pile, LOG_PILE, "Failed to combine positions %d-%d: %s",
+             chunk->first, chunk->first + chunk->count - 1,
+             (errptr != NULL) ? errptr : "capture numbering mismatch");
+    if (chunk->re != NULL) {
+      pcre_free(chunk->re);
+      chunk->re = NULL;
+    }
+    free(chunk->tags);
+    chunk->tags = NULL;
+    free(pattern);
+    return GROK_ERROR_COMPILE_FAILED;
+  }
+
+  chunk->re_extra = pcre_study(chunk->re, 0, &errptr);
+  chunk->num_captures = next_tag;
+  grok_log(pile, LOG_PILE, "Combined positions %d-%d into %d bytes of regexp",
+           chunk->first, chunk->first + chunk->count - 1, pattern_len);
+  free(pattern);
+  return GROK_OK;
+}
+
+static void grok_pile_clear_chunks(grok_pile_t *pile) {
+  int c;
+  for (c = 0; c < pile->nchunks; c++) {
+    grok_pile_chunk_t *chunk = pile->chunks + c;
+    if (chunk->re != NULL) {
+      pcre_free(chunk->re);
+    }
+    if (chunk->re_extra != NULL) {
+      pcre_free(chunk->re_extra);
+    }
+    free(chunk->tags);
+  }
+  free(pile->chunks);
+  pile->chunks = NULL;
+  pile->nchunks = 0;
+}
+
+/* Two members are swappable if they're both order-insensitive, or both
+ * anchored with no first byte in common: those can't match the same line. */
+static void grok_pile_build_swappable(grok_pile_t *pile) {
+  int i, j, k;
+  int n = pile->nmembers;
+
+  free(pile->swappable);
+  pile->swappable = calloc(n * n + 1, 1);
+
+  for (i = 0; i < n; i++) {
+    const grok_pile_member_t *a = pile->members + i;
+    for (j = i + 1; j < n; j++) {
+      const grok_pile_member_t *b = pile->members + j;
+      int swappable = 0;
+
+      if ((a->flags & GROK_PILE_ORDER_INSENSITIVE)
+          && (b->flags & GROK_PILE_ORDER_INSENSITIVE)) {
+        swappable = 1;
+      } else if (a->has_start_bits && b->has_start_bits) {
+        swappable = 1;
+        for (k = 0; k < 32; k++) {
+          if (a->start_bits[k] & b->start_bits[k]) {
+            swappable = 0;
+            break;
+          }
+        }
+      }
+      pile->swappable[i * n + j] = pile->swappable[j * n + i] = swappable;
+    }
+  }
+}
+
+/* Work out which bytes an anchored member's match can start with. PCRE
+ * doesn't study anchored patterns, so for a leading ^ we study the rest of
+ * the pattern instead: it matches at 0 exactly when the member does. PCRE
+ * also gives up on a leading \b, as in most grok patterns, so those are
+ * dropped; that only allows more matches, so the start bits stay a
+ * superset. */
+static void grok_pile_member_start_bits(grok_pile_member_t *member) {
+  const grok_t *grok = member->grok;
+  unsigned long options = 0;
+  int first_byte = -1;
+  const unsigned char *table = NULL;
+  pcre *rest = NULL;
+  pcre_extra *rest_extra = NULL;
+
+  member->has_start_bits = 0;
+  memset(member->start_bits, 0, sizeof(member->start_bits));
+
+  pcre_fullinfo(grok->re, NULL, PCRE_INFO_OPTIONS, &options);
+  if (!(options & PCRE_ANCHORED)) {
+    return;
+  }
+
+  pcre_fullinfo(grok->re, NULL, PCRE_INFO_FIRSTBYTE, &first_byte);
+  if (first_byte < 0 && grok->full_pattern[0] == '^') {
+    const char *errptr = NULL;
+    int erroffset = 0;
+    char *relaxed = grok_pile_strip_word_boundaries(grok->full_pattern + 1);
+    rest = pcre_compile(relaxed, 0, &errptr, &erroffset, NULL);
+    free(relaxed);
+    if (rest != NULL) {
+      pcre_fullinfo(rest, NULL, PCRE_INFO_FIRSTBYTE, &first_byte);
+      rest_extra = pcre_study(rest, 0, &errptr);
+      if (first_byte < 0 && rest_extra != NULL) {
+        pcre_fullinfo(rest, rest_extra, PCRE_INFO_FIRSTTABLE, &table);
+      }
+    }
+  }
+
+  if (first_byte >= 0) {
+    int c = first_byte & 0xff;
+    /* Same layout as PCRE's start bits table */
+    member->start_bits[c / 8] |= 1 << (c % 8);
+    if (first_byte & PCRE_BYTE_CASELESS) {
+      member->start_bits[tolower(c) / 8] |= 1 << (tolower(c) % 8);
+      member->start_bits[toupper(c) / 8] |= 1 << (toupper(c) % 8);
+    }
+    member->has_start_bits = 1;
+  } else if (table != NULL) {
+    memcpy(member->start_bits, table, sizeof(member->start_bits));
+    member->has_start_bits = 1;
+  }
+
+  if (rest_extra != NULL) {
+    pcre_free(rest_extra);
+  }
+  if (rest != NULL) {
+    pcre_free(rest);
+  }
+}
+
+/* Copy pattern without its \b and \B assertions, leaving escaped
+ * backslashes, character classes and \Q...\E alone. */
+static char *grok_pile_strip_word_boundaries(const char *pattern) {
+  char *copy = malloc(strlen(pattern) + 1);
+  char *out = copy;
+  const char *p = pattern;
+  int in_class = 0;
+
+  while (*p != '\0') {
+    if (*p == '\\' && p[1] == 'Q') {
+      const char *end = strstr(p, "\\E");
+      size_t len = (end != NULL) ? (size_t)(end + 2 - p) : strlen(p);
+      memcpy(out, p, len);
+      out += len;
+      p += len;
+      continue;
+    }
+    if (*p == '\\' && p[1] != '\0') {
+      if (in_class || (p[1] != 'b' && p[1] != 'B')) {
+        *out++ = p[0];
+        *out++ = p[1];
+      }
+      p += 2;
+      continue;
+    }
+    if (!in_class && *p == '[') {
+      in_class = 1;
+      *out++ = *p++;
+      /* a ] right after [ or [^ is a literal */
+      if (*p == '^') {
+        *out++ = *p++;
+      }
+      if (*p == ']') {
+        *out++ = *p++;
+      }
+      continue;
+    }
+    if (in_class && *p == ']') {
+      in_class = 0;
+    }
+    *out++ = *p++;
+  }
+  *out = '\0';
+  return copy;
+}
@@ -0,0 +1,213 @@
+/**
+ * @file grok_pile.h
+ */
+#ifndef _GROK_PILE_H_
+#define _GROK_PILE_H_
+#include "grok.h"
+#include "grok_literal.h"
+#include "grok_shape.h"
+
+/**
+ * A run of consecutive pile members compiled into one regexp.
+ *
+ * Each member is wrapped as a tagged lookahead branch,
+ * (?=[\s\S]*?(member)), and the branches are joined with '|' and
+ * compiled anchored. The first branch whose member matches anywhere in the
+ * subject wins, at that member's leftmost match, which is exactly what
+ * trying the members one at a time would have found.
+ */
+typedef struct grok_pile_chunk {
+  /** index of the first member in this chunk */
+  int first;
+
+  /** number of members in this chunk */
+  int count;
+
+  /** combined regexp, or NULL to run the single member with grok_execn */
+  pcre *re;
+  pcre_extra *re_extra;
+
+  /** capture count of re, including the 0th group */
+  int num_captures;
+
+  /** tags[i] is the capture number of member (first + i)'s tag group */
+  int *tags;
+} grok_pile_chunk_t;
+
+/** Number of entries in a pile's shape cache; a power of two */
+#define GROK_PILE_SHAPE_CACHE_SIZE 1024
+
+/**
+ * The order-insensitive member that last matched a line of each shape.
+ * It's only tried first when every candidate ahead of it in the evaluation
+ * order is swappable with it, which for two candidates means both are
+ * order-insensitive, so piles without such members skip the cache
+ * altogether. Entries are cleared when grok_pile_reorder() changes the
+ * order. Entries hold the upper
+ * 48 bits of grok_shape_fingerprint() and the member index + 1 in the lower
+ * 16, or 0 if empty. Direct mapped by the fingerprint's low bits; everything
+ * is read and written with relaxed atomics.
+ */
+typedef struct grok_pile_shape_cache {
+  uint64_t entries[GROK_PILE_SHAPE_CACHE_SIZE];
+
+  /** lines matched by the cached member, and lines that weren't */
+  uint64_t hits;
+  uint64_t misses;
+} grok_pile_shape_cache_t;
+
+/** Member flag: this member's priority relative to other order-insensitive
+ * members doesn't matter, so the pile may try them in any order. */
+#define GROK_PILE_ORDER_INSENSITIVE 1
+
+typedef struct grok_pile_member {
+  const grok_t *grok;
+  int flags;
+
+  /** set if the pile compiled grok itself and will free it */
+  int owned;
+
+  /** this member's index in the pile's evaluation order */
+  int position;
+
+  /** Bytes a match can start with. Only set for anchored members whose
+   * first byte PCRE could work out. */
+  int has_start_bits;
+  unsigned char start_bits[32];
+
+  /** Lines this member matched, and lines it was tried on (possibly ruled
+   * out by a prefilter) without matching. Updated with relaxed atomics. */
+  uint64_t hits;
+  uint64_t misses;
+} grok_pile_member_t;
+
+typedef struct grok_pile {
+  /** Pattern library shared by members from grok_pile_add_pattern(). Add
+   * to it with grok_pattern_add() and grok_patterns_import_from_file(). */
+  grok_t library;
+
+  /** members in priority order, the order they were added */
+  grok_pile_member_t *members;
+  int nmembers;
+  int members_size;
+
+  /** Member indexes in the order they're tried. Starts out as priority
+   * order; grok_pile_reorder() moves frequently matching members forward
+   * when that can't change which member matches a line. */
+  int *order;
+
+  /** swappable[i * nmembers + j] is set if members i and j can never match
+   * the same line, or are both order-insensitive. NULL until
+   * grok_pile_compile(), and again once another member is added; until
+   * then, nothing is reordered and the shape cache isn't used. */
+  unsigned char *swappable;
+
+  /** Evaluation plan built by grok_pile_compile(), in evaluation order.
+   * Members added since are in no chunk, and are tried one at a time after
+   * the chunks. */
+  grok_pile_chunk_t *chunks;
+  int nchunks;
+
+  /** Literals that must appear in a member's matches. A member is only
+   * run if all of its literals are present; member i's literal ids are
+   * member_literals[member_literal_start[i] .. member_literal_start[i + 1]) */
+  grok_literal_index_t literals;
+  int *member_literals;
+  int *member_literal_start;
+
+  /** First byte dispatch: row b, GROK_BITSET_WORDS(nmembers) words at
+   * dispatch + b * words, is the set of members that can match a line
+   * starting with byte b; row 256 is for the empty line. Members without
+   * start bits are in every row. NULL until grok_pile_compile(), and again
+   * once another member is added, when every member is a candidate. */
+  uint64_t *dispatch;
+
+  /** written by grok_pile_execn(), so kept out of the const pile */
+  grok_pile_shape_cache_t *shapes;
+
+  /** members added with GROK_PILE_ORDER_INSENSITIVE; the shape cache is
+   * only used if there are any */
+  int ninsensitive;
+
+  unsigned int logmask;
+  unsigned int logdepth;
+  char *errstr;
+} grok_pile_t;
+
+grok_pile_t *grok_pile_new();
+void grok_pile_init(grok_pile_t *pile);
+void grok_pile_clean(grok_pile_t *pile);
+void grok_pile_free(grok_pile_t *pile);
+
+/**
+ * Add a compiled grok_t to the end of the pile. The pile keeps a pointer
+ * to it, so it must outlive the pile. Call grok_pile_compile() after
+ * adding members.
+ *
+ * @returns GROK_OK, or GROK_ERROR_UNINITIALIZED if member isn't compiled.
+ */
+int grok_pile_add(grok_pile_t *pile, const grok_t *member);
+
+/**
+ * Add a member with GROK_PILE_* flags.
+ */
+int grok_pile_add_flags(grok_pile_t *pile, const grok_t *member, int flags);
+
+/**
+ * Compile a pattern against the pile's pattern library and add it to the
+ * end of the pile. The pile owns the new member, which is
+ * pile->members[pile->nmembers - 1].grok.
+ *
+ * @returns GROK_OK, or the grok_compilen() error with pile->errstr set.
+ */
+int grok_pile_add_pattern(grok_pile_t *pile, const char *pattern, int length,
+                          int only_renamed, int flags);
+
+/**
+ * @returns the grok_t of a member, by index in priority order.
+ */
+const grok_t *grok_pile_member(const grok_pile_t *pile, int member);
+
+/**
+ * Build the combined regexps for the current members.
+ */
+int grok_pile_compile(grok_pile_t *pile);
+
+/**
+ * Find the first member, in the order they were added, matching text.
+ *
+ * @param member set to the index of the member that matched.
+ * @param gm set to the match, as if grok_execn() had been called on the
+ *        matching member. If NULL, no storing is attempted.
+ * @returns GROK_OK if a member matched, GROK_ERROR_NOMATCH otherwise.
+ */
+int grok_pile_execn(const grok_pile_t *pile, const char *text, int textlen,
+                    int *member, grok_match_t *gm);
+
+/**
+ * Reorder evaluation by hit count, most frequent first, keeping members
+ * that aren't swappable in priority order. Like grok_pile_compile(), this
+ * must not run concurrently with anything else using the pile. Does nothing
+ * if members were added since the last grok_pile_compile().
+ *
+ * @returns 1 if the order changed and the pile was recompiled, 0 otherwise.
+ */
+int grok_pile_reorder(grok_pile_t *pile);
+
+/**
+ * Read a member's hit and miss counters and its current position in the
+ * evaluation order. Safe to call while other threads are matching.
+ *
+ * @returns GROK_OK, or GROK_ERROR_UNINITIALIZED if there's no such member.
+ */
+int grok_pile_member_stats(const grok_pile_t *pile, int member,
+                           uint64_t *hits, uint64_t *misses, int *position);
+
+/**
+ * Read the shape cache's hit and miss counters. Safe to call while other
+ * threads are matching.
+ */
+void grok_pile_shape_stats(const grok_pile_t *pile, uint64_t *hits,
+                           uint64_t *misses);
+
+#endif /* _GROK_PILE_H_ */
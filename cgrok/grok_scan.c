@@ -0,0 +1,52 @@
+#include "grok.h"
+#include "grok_scan.h"
+
+/* Capture vectors up to this many ints live on the stack */
+#define SCAN_STACK_VECTOR 96
+
+int grok_scan_buffer(const grok_t *grok, const char *buf, int len, int final,
+                     grok_scan_callback cb, void *data) {
+  int stack_vector[SCAN_STACK_VECTOR];
+  int *vector = stack_vector;
+  int vector_size = grok->pcre_num_captures * 3;
+  const char *line = buf;
+  const char *end = buf + len;
+
+  if (vector_size > SCAN_STACK_VECTOR) {
+    vector = malloc(vector_size * sizeof(int));
+  }
+
+  while (line < end) {
+    const char *newline = memchr(line, '\n', end - line);
+    const char *next;
+    int line_len;
+    int ret, stop;
+
+    if (newline == NULL) {
+      if (!final) {
+        break;
+      }
+      newline = end;
+      next = end;
+    } else {
+      next = newline + 1;
+    }
+
+    line_len = newline - line;
+    if (line_len > 0 && line[line_len - 1] == '\r') {
+      line_len--;
+    }
+
+    ret = grok_execn_vector(grok, line, line_len, vector, vector_size);
+    stop = cb(grok, line, line_len, ret, ret == GROK_OK ? vector : NULL, data);
+    line = next;
+    if (stop) {
+      break;
+    }
+  }
+
+  if (vector != stack_vector) {
+    free(vector);
+  }
+  return line - buf;
+}
@@ -0,0 +1,34 @@
+/**
+ * @file grok_scan.h
+ */
+#ifndef _GROK_SCAN_H_
+#define _GROK_SCAN_H_
+#include "grok.h"
+
+/**
+ * Called by grok_scan_buffer() for each line.
+ *
+ * @param line the line, without its newline or a trailing carriage return.
+ *        It points into the scanned buffer and isn't NUL terminated.
+ * @param ret GROK_OK if the line matched, otherwise the grok_execn() error.
+ * @param vector the PCRE capture vector if the line matched, else NULL.
+ *        Only valid until the callback returns.
+ * @returns 0 to carry on, or nonzero to stop scanning after this line.
+ */
+typedef int (*grok_scan_callback)(const grok_t *grok, const char *line,
+                                  int line_len, int ret, const int *vector,
+                                  void *data);
+
+/**
+ * Split buf into lines on '\n' and match each one in place.
+ *
+ * @param final if zero, a last line without a newline is left unscanned,
+ *        for the caller to complete with more input. Otherwise it's
+ *        scanned like any other.
+ * @returns the number of bytes consumed, up to and including the last
+ *          newline scanned.
+ */
+int grok_scan_buffer(const grok_t *grok, const char *buf, int len, int final,
+                     grok_scan_callback cb, void *data);
+
+#endif /* _GROK_SCAN_H_ */
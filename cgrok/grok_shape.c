@@ -0,0 +1,41 @@
+#include "grok.h"
+#include "grok_shape.h"
+
+/* FNV-1a */
+#define SHAPE_HASH_OFFSET 14695981039346656037ULL
+#define SHAPE_HASH_PRIME 1099511628211ULL
+
+/* Token class of a byte: '0' for digits, 'a' for letters (counting any
+ * non-ASCII byte as a letter), ' ' for whitespace, and punctuation stands
+ * for itself. */
+static unsigned char shape_class(unsigned char c) {
+  if (c >= '0' && c <= '9') {
+    return '0';
+  }
+  if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_'
+      || c >= 0x80) {
+    return 'a';
+  }
+  if (c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+    return ' ';
+  }
+  return c;
+}
+
+uint64_t grok_shape_fingerprint(const char *text, int textlen) {
+  uint64_t hash = SHAPE_HASH_OFFSET;
+  int prev = -1;
+  int i;
+
+  for (i = 0; i < textlen; i++) {
+    unsigned char cls = shape_class((unsigned char)text[i]);
+    /* Runs of a class count once, so values of any length look alike */
+    if (cls == prev) {
+      continue;
+    }
+    hash ^= cls;
+    hash *= SHAPE_HASH_PRIME;
+    prev = cls;
+  }
+  return hash;
+}
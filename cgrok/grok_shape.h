@@ -0,0 +1,18 @@
+/**
+ * @file grok_shape.h
+ */
+#ifndef _GROK_SHAPE_H_
+#define _GROK_SHAPE_H_
+#include "grok.h"
+
+/**
+ * The shape of a line is its sequence of token classes: runs of digits,
+ * of letters, of whitespace, or of one punctuation character.
+ * Lines in the same format mostly have the same shape, whatever the
+ * values in them.
+ *
+ * @returns a 64 bit hash of text's shape.
+ */
+uint64_t grok_shape_fingerprint(const char *text, int textlen);
+
+#endif /* _GROK_SHAPE_H_ */
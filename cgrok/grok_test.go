@@ -1,7 +1,13 @@
 package grok
 
 import (
+	"bufio"
 	"fmt"
+	"io/ioutil"
+	"os"
+	"runtime"
+	"strconv"
+	"strings"
 	"sync"
 	"testing"
 )
@@ -420,3 +426,1549 @@ func TestMoreThan128NamedGroups(t *testing.T) {
 	m.EndIterator()
 	m.Free()
 }
+
+func TestCompileStats(t *testing.T) {
+	g := New()
+	defer g.Free()
+
+	if _, err := g.CompileStats(); err == nil {
+		t.Fatal("Expected an error before compiling")
+	}
+
+	g.AddPatternsFromFile("../patterns/base")
+	pattern := "^%{SYSLOGTIMESTAMP:ts} %{WORD:host}"
+	if err := g.Compile(pattern, false); err != nil {
+		t.Fatal(err)
+	}
+	stats, err := g.CompileStats()
+	if err != nil {
+		t.Fatal(err)
+	}
+	if stats.PatternLen != len(pattern) {
+		t.Fatalf("Expected pattern length %v, got %v", len(pattern), stats.PatternLen)
+	}
+	if stats.FullPatternLen <= stats.PatternLen {
+		t.Fatal("Expanded pattern should be longer than the original")
+	}
+	/* SYSLOGTIMESTAMP, MONTH, MONTHDAY, TIME, HOUR, MINUTE, SECOND, WORD */
+	if stats.Expansions != 8 {
+		t.Fatalf("Expected 8 expansions, got %v", stats.Expansions)
+	}
+	/* SYSLOGTIMESTAMP -> TIME -> HOUR */
+	if stats.MaxDepth != 3 {
+		t.Fatalf("Expected max depth 3, got %v", stats.MaxDepth)
+	}
+	if stats.CaptureCount < stats.Expansions {
+		t.Fatal("Every expansion should add a capture")
+	}
+	if stats.CompiledSize == 0 {
+		t.Fatal("Expected a non-zero compiled size")
+	}
+	if !stats.Anchored {
+		t.Fatal("Pattern starting with ^ should be anchored")
+	}
+
+	g.Compile("foo[0-9]+bar", false)
+	stats, _ = g.CompileStats()
+	if stats.FirstByte != 'f' || stats.RequiredByte != 'r' || stats.Anchored {
+		t.Fatalf("Unexpected first/required byte info: %+v", stats)
+	}
+	if stats.Expansions != 0 || stats.MaxDepth != 0 {
+		t.Fatal("Plain regexp should have no expansions")
+	}
+
+	g.Compile("[0-9]+", false)
+	stats, _ = g.CompileStats()
+	if !stats.HasStartBits || stats.StudySize == 0 {
+		t.Fatalf("Expected a start-bit table from pcre_study: %+v", stats)
+	}
+}
+
+func TestPilePriority(t *testing.T) {
+	p := NewPile()
+	defer p.Free()
+
+	p.AddPatternsFromFile("../patterns/base")
+	/* The second pattern matches earlier in the line, but the first one
+	   was added first and must win. */
+	p.Compile("port %{INT:port}", false)
+	p.Compile("%{IP:ip}", false)
+	p.Compile("^%{WORD:first}", false)
+
+	text := "10.1.2.3 connected on port 8080"
+	grok, match := p.Match(text)
+	if match == nil {
+		t.Fatal("Expected a match")
+	}
+	if grok != p.Groks[0] {
+		t.Fatal("Expected the first pattern to match")
+	}
+	captures := match.Captures()
+	if port := captures["INT:port"][0]; port != "8080" {
+		t.Fatalf("Expected port 8080, got %q", port)
+	}
+	if idx := match.FindIndex(); idx[0] != 22 || idx[1] != 31 {
+		t.Fatalf("Unexpected match indices %v", idx)
+	}
+	match.Free()
+
+	grok, match = p.Match("client 10.1.2.3")
+	if grok != p.Groks[1] {
+		t.Fatal("Expected the IP pattern to match")
+	}
+	if ip := match.Captures()["IP:ip"][0]; ip != "10.1.2.3" {
+		t.Fatalf("Expected ip 10.1.2.3, got %q", ip)
+	}
+	match.Free()
+
+	grok, match = p.Match("hello there")
+	if grok != p.Groks[2] {
+		t.Fatal("Expected the anchored WORD pattern to match")
+	}
+	if first := match.Captures()["WORD:first"][0]; first != "hello" {
+		t.Fatalf("Expected hello, got %q", first)
+	}
+	match.Free()
+
+	if grok, match = p.Match("!!!"); grok != nil || match != nil {
+		t.Fatal("Expected no match")
+	}
+
+	/* A pattern using a backreference can't be combined, but still has
+	   to be tried in order */
+	p.Compile("(a)\\1", false)
+	p.Compile("zz", false)
+	if grok, _ = p.Match("..aa zz"); grok != p.Groks[3] {
+		t.Fatal("Expected the backreference pattern to match")
+	}
+	if grok, _ = p.Match("--zz"); grok != p.Groks[4] {
+		t.Fatal("Expected the last pattern to match")
+	}
+}
+
+func TestPileLiterals(t *testing.T) {
+	p := NewPile()
+	defer p.Free()
+
+	p.AddPatternsFromFile("../patterns/base")
+	p.Compile("REST\\.%{WORD:op}", false)
+	p.Compile("sshd\\[%{INT:pid}\\]: %{GREEDYDATA:msg}", false)
+	p.Compile("(?:foo|bar) %{INT:n}", false)
+	p.Compile("user=%{WORD:user}", false)
+
+	/* The literals of the first two members are missing, so they are
+	   skipped without running their regexps */
+	grok, match := p.Match("host sshd: bar 12 user=root")
+	if grok != p.Groks[2] {
+		t.Fatal("Expected the alternation pattern to match")
+	}
+	if n := match.Captures()["INT:n"][0]; n != "12" {
+		t.Fatalf("Expected n 12, got %q", n)
+	}
+	match.Free()
+
+	/* A literal being present doesn't mean the member matches */
+	grok, match = p.Match("sshd[abc]: user=root")
+	if grok != p.Groks[3] {
+		t.Fatal("Expected the user pattern to match")
+	}
+	if user := match.Captures()["WORD:user"][0]; user != "root" {
+		t.Fatalf("Expected user root, got %q", user)
+	}
+	match.Free()
+
+	grok, match = p.Match("sshd[42]: Accepted REST.GET")
+	if grok != p.Groks[0] {
+		t.Fatal("Expected the REST pattern to match")
+	}
+	if op := match.Captures()["WORD:op"][0]; op != "GET" {
+		t.Fatalf("Expected op GET, got %q", op)
+	}
+	match.Free()
+
+	if grok, match = p.Match("nothing to see"); grok != nil || match != nil {
+		t.Fatal("Expected no match")
+	}
+}
+
+func TestPileReorder(t *testing.T) {
+	p := NewPile()
+	defer p.Free()
+
+	p.AddPatternsFromFile("../patterns/base")
+	p.Compile("^<%{POSINT:pri}>", false)
+	p.Compile("^%{INT:num} ", false)
+	p.Compile("^%{USERNAME:user}", false)
+	p.Compile("%{IP:ip}", false)
+
+	for i := 0; i < 10; i++ {
+		p.Match("42 apples")
+	}
+	for i := 0; i < 20; i++ {
+		p.Match("hello")
+	}
+
+	stats := p.Stats()
+	expected := []PileStats{{0, 30, 0}, {10, 20, 1}, {20, 0, 2}, {0, 0, 3}}
+	for i := range expected {
+		if stats[i] != expected[i] {
+			t.Fatalf("Expected stats %v, got %v", expected, stats)
+		}
+	}
+
+	/* None of the members are order-insensitive, so the shape cache has
+	   nothing it could try out of order */
+	if hits, misses := p.ShapeCacheStats(); hits != 0 || misses != 0 {
+		t.Fatalf("Expected the shape cache to be unused, got %d hits and %d misses", hits, misses)
+	}
+
+	/* The USERNAME pattern can't start with '<', so it can move ahead of the
+	   first pattern, but not ahead of the INT pattern which it overlaps. */
+	p.Reorder()
+	stats = p.Stats()
+	positions := []int{2, 0, 1, 3}
+	for i := range positions {
+		if stats[i].Position != positions[i] {
+			t.Fatalf("Expected positions %v, got %v", positions, stats)
+		}
+	}
+
+	/* Priority order still decides */
+	lines := map[string]int{"<13>hi": 0, "42 apples": 1, "hello": 2,
+		"10.0.0.1": 2, "!! 10.0.0.1": 3}
+	for line, index := range lines {
+		if grok, _ := p.Match(line); grok != p.Groks[index] {
+			t.Fatalf("Expected %q to match pattern %d", line, index)
+		}
+	}
+}
+
+func TestPileOrderInsensitive(t *testing.T) {
+	p := NewPile()
+	defer p.Free()
+
+	p.AddPatternsFromFile("../patterns/base")
+	p.CompileOrderInsensitive("^foo %{INT:a}", false)
+	p.CompileOrderInsensitive("%{INT:b} ms", false)
+
+	if grok, _ := p.Match("foo 5 ms"); grok != p.Groks[0] {
+		t.Fatal("Expected the first pattern to match before reordering")
+	}
+	for i := 0; i < 10; i++ {
+		p.Match("5 ms")
+	}
+
+	/* Both match this line, but as neither cares about priority, the one
+	   with more hits goes first */
+	p.Reorder()
+	if stats := p.Stats(); stats[1].Position != 0 {
+		t.Fatalf("Expected the second pattern to go first, got %v", stats)
+	}
+	if grok, _ := p.Match("foo 5 ms"); grok != p.Groks[1] {
+		t.Fatal("Expected the second pattern to match after reordering")
+	}
+}
+
+func TestPileDispatch(t *testing.T) {
+	p := NewPile()
+	defer p.Free()
+
+	p.AddPatternsFromFile("../patterns/base")
+	p.Compile("^<%{POSINT:pri}>%{GREEDYDATA:msg}", false)
+	p.Compile("^%{SYSLOGTIMESTAMP:ts} %{WORD:host}", false)
+	p.Compile("^%{INT:num}", false)
+	p.Compile("^x?$", false)
+	p.Compile("%{WORD:word}", false)
+
+	lines := map[string]int{
+		"<13>Oct 11 22:14:15 host": 0,
+		"Oct 11 22:14:15 host":     1,
+		"12 Oct":                   2,
+		"":                         3,
+		"x":                        3,
+		"- Oct 11 22:14:15 host":   4,
+		" <13>":                    4,
+	}
+	for line, index := range lines {
+		if grok, _ := p.Match(line); grok != p.Groks[index] {
+			t.Fatalf("Expected %q to match pattern %d", line, index)
+		}
+	}
+	if grok, _ := p.Match("<>"); grok != nil {
+		t.Fatal("Expected no match")
+	}
+}
+
+func TestPileSharedLibrary(t *testing.T) {
+	p := NewPile()
+	defer p.Free()
+
+	p.AddPatternsFromFile("../patterns/base")
+	p.AddPattern("GREETING", "hello|hi")
+	if err := p.Compile("%{GREETING:g} %{WORD:name}", false); err != nil {
+		t.Fatal(err)
+	}
+
+	/* Patterns added later are seen by later Compiles */
+	p.AddPattern("FAREWELL", "bye")
+	if err := p.Compile("%{FAREWELL:f} %{INT:n}", false); err != nil {
+		t.Fatal(err)
+	}
+	if err := p.Compile("(%{GREETING:g}", false); err == nil {
+		t.Fatal("Expected a compile error")
+	}
+	if len(p.Groks) != 2 {
+		t.Fatalf("Expected 2 groks, got %d", len(p.Groks))
+	}
+
+	grok, match := p.Match("bye 3")
+	if grok != p.Groks[1] {
+		t.Fatal("Expected the second pattern to match")
+	}
+	if n := match.Captures()["INT:n"][0]; n != "3" {
+		t.Fatalf("Expected n 3, got %q", n)
+	}
+	match.Free()
+
+	p.AddPatternsFromFile("/does/not/exist")
+	if err := p.Compile("%{WORD:w}", false); err == nil {
+		t.Fatal("Expected an error for a missing pattern file")
+	}
+}
+
+func TestPileShapeCache(t *testing.T) {
+	p := NewPile()
+	defer p.Free()
+
+	p.AddPatternsFromFile("../patterns/base")
+	p.CompileOrderInsensitive("user %{WORD:user} logged in", false)
+	p.CompileOrderInsensitive("took %{INT:ms} ms", false)
+	p.CompileOrderInsensitive("(?:GET|PUT) %{INT:status}", false)
+	p.CompileOrderInsensitive("%{WORD:a} %{WORD:b}", false)
+
+	lines := []string{"took 12 ms", "user bob logged in", "took 345 ms",
+		"user alice logged in", "GET 200", "PUT 404"}
+	expected := []int{1, 0, 1, 0, 2, 2}
+	for i, line := range lines {
+		grok, match := p.Match(line)
+		if grok != p.Groks[expected[i]] {
+			t.Fatalf("Expected %q to match pattern %d", line, expected[i])
+		}
+		match.Free()
+	}
+
+	/* The second line of each shape came from the cache */
+	hits, misses := p.ShapeCacheStats()
+	if hits != 3 || misses != 0 {
+		t.Fatalf("Expected 3 cache hits and no misses, got %d and %d", hits, misses)
+	}
+
+	/* Same shape, different format: the cached member fails and the rest
+	   are tried */
+	if grok, _ := p.Match("FOO 200"); grok != p.Groks[3] {
+		t.Fatal("Expected the generic pattern to match")
+	}
+	if _, misses = p.ShapeCacheStats(); misses != 1 {
+		t.Fatalf("Expected a cache miss, got %d", misses)
+	}
+}
+
+func TestPileShapeCacheOrder(t *testing.T) {
+	p := NewPile()
+	defer p.Free()
+
+	/* Both can match the same lines, and only the second is
+	   order-insensitive, so they aren't swappable and the first keeps
+	   priority */
+	p.AddPatternsFromFile("../patterns/base")
+	p.Compile("^took 9%{INT:ms} ms", false)
+	p.CompileOrderInsensitive("^took %{INT:ms} ms", false)
+
+	lines := []string{"took 12 ms", "took 13 ms", "took 95 ms", "took 14 ms"}
+	expected := []int{1, 1, 0, 1}
+	for i, line := range lines {
+		grok, match := p.Match(line)
+		if grok != p.Groks[expected[i]] {
+			t.Fatalf("Expected %q to match pattern %d", line, expected[i])
+		}
+		match.Free()
+	}
+
+	/* Every line has the same shape. The first pattern's literal rules it
+	   out for "took 13 ms" and "took 14 ms", so the second could come from
+	   the cache; for "took 95 ms" the first is a candidate, so the cache was
+	   skipped, and the first isn't cached since it isn't order-insensitive */
+	hits, misses := p.ShapeCacheStats()
+	if hits != 2 || misses != 0 {
+		t.Fatalf("Expected 2 cache hits and no misses, got %d and %d", hits, misses)
+	}
+
+	/* A cache hit counts a miss for the member ahead, as the full
+	   evaluation would */
+	if stats := p.Stats(); stats[0] != (PileStats{1, 3, 0}) {
+		t.Fatalf("Expected the first pattern to have 1 hit and 3 misses, got %v", stats[0])
+	}
+}
+
+func TestPredicates(t *testing.T) {
+	g := New()
+	defer g.Free()
+	g.AddPatternsFromFile("../patterns/base")
+
+	tests := []struct {
+		pattern, text, name, expected string
+	}{
+		{"%{INT:x > 100}", "5 50 500", "INT:x", "500"},
+		{"%{POSINT:x <= 10} %{INT:y}", "50 5 7", "POSINT:x", "5"},
+		{"%{WORD:w =~ /^b/}", "apple banana", "WORD:w", "banana"},
+		{"%{WORD:w !~ /^a/}", "apple banana", "WORD:w", "banana"},
+		{"%{WORD:w =~ /^%{POSINT}$/}", "abc 123", "WORD:w", "123"},
+		{"%{WORD:w !~ /^%{POSINT}$/} x", "123 x abc x", "WORD:w", "abc"},
+		{"%{IPORHOST:h =~ /\\./}:%{POSINT}", "localhost:80 example.com:443", "IPORHOST:h", "example.com"},
+	}
+	for _, test := range tests {
+		if err := g.Compile(test.pattern, false); err != nil {
+			t.Fatal(err)
+		}
+		captures := g.Match(test.text).Captures()
+		if value := captures[test.name][0]; value != test.expected {
+			t.Fatalf("%s: expected %q, got %q", test.pattern, test.expected, value)
+		}
+	}
+
+	if err := g.Compile("%{INT:x > 100}", false); err != nil {
+		t.Fatal(err)
+	}
+	if match := g.Match("5 50"); match != nil {
+		t.Fatal("Expected no match")
+	}
+
+	/* Members with predicates are run on their own in a Pile */
+	p := NewPile()
+	defer p.Free()
+	p.AddPatternsFromFile("../patterns/base")
+	p.Compile("took %{INT:ms > 1000} ms", false)
+	p.Compile("took %{INT:ms} ms", false)
+	if grok, _ := p.Match("took 20 ms"); grok != p.Groks[1] {
+		t.Fatal("Expected the second pattern to match")
+	}
+	if grok, _ := p.Match("took 2000 ms"); grok != p.Groks[0] {
+		t.Fatal("Expected the first pattern to match")
+	}
+
+	/* PCRE callout numbers stop at 255, and a predicate past that can't be
+	   checked */
+	pattern := strings.Repeat("%{INT:x > 0} ", 255)
+	if err := g.Compile(pattern, false); err != nil {
+		t.Fatal(err)
+	}
+	if err := g.Compile(pattern+"%{INT:x > 0}", false); err == nil || !strings.Contains(err.Error(), "Too many predicates") {
+		t.Fatalf("Expected too many predicates, got %v", err)
+	}
+}
+
+func TestRegexpPredicateCache(t *testing.T) {
+	before := RegexpPredicateCacheSize()
+
+	g1 := New()
+	g1.AddPatternsFromFile("../patterns/base")
+	if err := g1.Compile("%{WORD:w =~ /^(?:%{POSINT})$/}", false); err != nil {
+		t.Fatal(err)
+	}
+	if size := RegexpPredicateCacheSize(); size != before+1 {
+		t.Fatalf("Expected %d cached regexps, got %d", before+1, size)
+	}
+
+	/* The same predicate in another Grok shares the compiled regexp */
+	g2 := New()
+	defer g2.Free()
+	g2.AddPatternsFromFile("../patterns/base")
+	if err := g2.Compile("%{WORD:w =~ /^(?:%{POSINT})$/}", false); err != nil {
+		t.Fatal(err)
+	}
+	if size := RegexpPredicateCacheSize(); size != before+1 {
+		t.Fatalf("Expected %d cached regexps, got %d", before+1, size)
+	}
+
+	/* and it outlives the Grok that compiled it first */
+	g1.Free()
+	match := g2.Match("abc 123")
+	if match == nil {
+		t.Fatal("Expected a match")
+	}
+	if value := match.Captures()["WORD:w"][0]; value != "123" {
+		t.Fatalf("Expected %q, got %q", "123", value)
+	}
+	if match := g2.Match("abc def"); match != nil {
+		t.Fatal("Expected no match")
+	}
+
+	/* The sense of the match is part of the key */
+	if err := g2.Compile("%{WORD:w !~ /^(?:%{POSINT})$/}", false); err != nil {
+		t.Fatal(err)
+	}
+	if size := RegexpPredicateCacheSize(); size != before+2 {
+		t.Fatalf("Expected %d cached regexps, got %d", before+2, size)
+	}
+	if value := g2.Match("123 abc").Captures()["WORD:w"][0]; value != "abc" {
+		t.Fatalf("Expected %q, got %q", "abc", value)
+	}
+}
+
+func TestExpand(t *testing.T) {
+	g := New()
+	defer g.Free()
+	g.AddPatternsFromFile("../patterns/base")
+	if err := g.Compile("%{WORD:w} %{INT:n}", false); err != nil {
+		t.Fatal(err)
+	}
+	names := g.CaptureNames()
+
+	expanded, err := g.Expand("%{IPORHOST:h =~ /\\./}:%{POSINT:port > 10}")
+	if err != nil {
+		t.Fatal(err)
+	}
+	if strings.Contains(expanded, "%{") || strings.Contains(expanded, "(?C") {
+		t.Fatalf("Expected no patterns or callouts in %q", expanded)
+	}
+	if strings.Join(g.CaptureNames(), ",") != strings.Join(names, ",") {
+		t.Fatalf("Expected captures %v, got %v", names, g.CaptureNames())
+	}
+
+	/* The expansion is plain regexp and captures nothing */
+	plain := New()
+	defer plain.Free()
+	if err := plain.Compile(expanded, false); err != nil {
+		t.Fatal(err)
+	}
+	match := plain.Match("example.com:443")
+	if match == nil {
+		t.Fatal("Expected a match")
+	}
+	if captures := match.Captures(); len(captures) != 0 {
+		t.Fatalf("Expected no captures, got %v", captures)
+	}
+}
+
+func TestParseNumbers(t *testing.T) {
+	g := New()
+	defer g.Free()
+	g.AddPatternsFromFile("../patterns/base")
+
+	if err := g.Compile("%{INT:status} %{NUMBER:secs} %{WORD:w}", false); err != nil {
+		t.Fatal(err)
+	}
+	match := g.Match("GET 404 -0.25 done")
+	if value, err := match.Int("INT:status"); err != nil || value != 404 {
+		t.Fatalf("Expected 404, got %d (%v)", value, err)
+	}
+	if value, err := match.Float("NUMBER:secs"); err != nil || value != -0.25 {
+		t.Fatalf("Expected -0.25, got %g (%v)", value, err)
+	}
+	if _, err := match.Int("WORD:w"); err == nil {
+		t.Fatal("Expected an error converting a word")
+	}
+	if _, err := match.Int("INT:missing"); err == nil {
+		t.Fatal("Expected an error for a missing capture")
+	}
+
+	if err := g.Compile("%{NUMBER:x > 1.5}", false); err != nil {
+		t.Fatal(err)
+	}
+	if value := g.Match("0.5 1.25 -3 2.75").Captures()["NUMBER:x"][0]; value != "2.75" {
+		t.Fatalf("Expected 2.75, got %q", value)
+	}
+
+	/* Predicates read numbers as strtol and strtod do: 010 is octal, and
+	   leading whitespace of any kind is skipped */
+	tests := []struct {
+		pattern, text, name, expected string
+	}{
+		{"%{INT:x > 010}", "7 8 9", "INT:x", "9"},
+		{"%{BASE16NUM:x > 0x10}", "0x0f 0x10 0x11", "BASE16NUM:x", "0x11"},
+		{"%{INT:x > \t\n12}", "12 13", "INT:x", "13"},
+		{"%{NOTSPACE:x > 1.5e2}", "1e2 0x1p8", "NOTSPACE:x", "0x1p8"},
+	}
+	for _, test := range tests {
+		if err := g.Compile(test.pattern, false); err != nil {
+			t.Fatal(err)
+		}
+		match := g.Match(test.text)
+		if match == nil {
+			t.Fatalf("%s: expected a match in %q", test.pattern, test.text)
+		}
+		if value := match.Captures()[test.name][0]; value != test.expected {
+			t.Fatalf("%s: expected %q, got %q", test.pattern, test.expected, value)
+		}
+	}
+
+	/* Match.Int is decimal only, so zero-padded numbers aren't octal */
+	if err := g.Compile("%{INT:n}", false); err != nil {
+		t.Fatal(err)
+	}
+	if value, err := g.Match("0755").Int("INT:n"); err != nil || value != 755 {
+		t.Fatalf("Expected 755, got %d (%v)", value, err)
+	}
+}
+
+func TestInPredicate(t *testing.T) {
+	g := New()
+	defer g.Free()
+	g.AddPatternsFromFile("../patterns/base")
+
+	hosts, err := ioutil.TempFile("", "grok-hosts")
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer os.Remove(hosts.Name())
+	hosts.WriteString("# allowed hosts\nweb1\r\n  db2  \n\nweb1\n")
+	hosts.Close()
+
+	tests := []struct {
+		pattern, text, name, expected string
+	}{
+		{"%{WORD:verb @in {GET, POST,PUT}}", "FETCH PUT GET", "WORD:verb", "PUT"},
+		{"%{WORD:verb !@in {GET,POST}}", "GET POST HEAD", "WORD:verb", "HEAD"},
+		{"%{INT:status @in {404,500}} ", "200 404 500 ", "INT:status", "404"},
+		{"%{WORD:host @in file:" + hosts.Name() + "}", "web db2 web1", "WORD:host", "db2"},
+	}
+	for _, test := range tests {
+		if err := g.Compile(test.pattern, false); err != nil {
+			t.Fatal(err)
+		}
+		match := g.Match(test.text)
+		if match == nil {
+			t.Fatalf("%s: expected a match", test.pattern)
+		}
+		if value := match.Captures()[test.name][0]; value != test.expected {
+			t.Fatalf("%s: expected %q, got %q", test.pattern, test.expected, value)
+		}
+	}
+
+	if err := g.Compile("^%{WORD:verb @in {GET,POST}}$", false); err != nil {
+		t.Fatal(err)
+	}
+	for _, text := range []string{"GE", "GETS", "get", "#", ""} {
+		if match := g.Match(text); match != nil {
+			t.Fatalf("Expected no match for %q", text)
+		}
+	}
+
+	/* Without its set the predicate can't be checked, so the pattern
+	   doesn't compile */
+	for _, pattern := range []string{
+		"%{WORD:verb @in GET,POST}",
+		"%{WORD:verb !@in file:" + hosts.Name() + ".missing}",
+	} {
+		if err := g.Compile(pattern, false); err == nil || !strings.Contains(err.Error(), "Invalid @in predicate") {
+			t.Fatalf("%s: expected an invalid predicate, got %v", pattern, err)
+		}
+	}
+}
+
+func TestCidrPredicate(t *testing.T) {
+	g := New()
+	defer g.Free()
+	g.AddPatternsFromFile("../patterns/base")
+
+	ranges, err := ioutil.TempFile("", "grok-ranges")
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer os.Remove(ranges.Name())
+	ranges.WriteString("# internal\n10.0.0.0/8\n192.168.0.0/16\n\n203.0.113.7\n")
+	ranges.Close()
+
+	tests := []struct {
+		pattern, text, expected string
+	}{
+		{"%{IP:client @cidr file:" + ranges.Name() + "}", "8.8.8.8 203.0.113.8 10.1.2.3", "10.1.2.3"},
+		{"%{IP:client @cidr file:" + ranges.Name() + "}", "11.0.0.1 203.0.113.7", "203.0.113.7"},
+		{"%{IP:client !@cidr file:" + ranges.Name() + "}", "10.0.0.1 192.168.9.9 172.16.0.1", "172.16.0.1"},
+		{"%{IP:client @cidr {172.16.0.0/12, 0.0.0.0/32}}", "172.32.0.1 172.31.255.255", "172.31.255.255"},
+	}
+	for _, test := range tests {
+		if err := g.Compile(test.pattern, false); err != nil {
+			t.Fatal(err)
+		}
+		match := g.Match(test.text)
+		if match == nil {
+			t.Fatalf("%s: expected a match", test.pattern)
+		}
+		if value := match.Captures()["IP:client"][0]; value != test.expected {
+			t.Fatalf("%s: expected %q, got %q", test.pattern, test.expected, value)
+		}
+	}
+
+	if err := g.Compile("^%{IP:client @cidr {10.0.0.0/8}}$", false); err != nil {
+		t.Fatal(err)
+	}
+	for _, text := range []string{"9.255.255.255", "11.0.0.0", "::1"} {
+		if match := g.Match(text); match != nil {
+			t.Fatalf("Expected no match for %q", text)
+		}
+	}
+
+	/* A deny list that can't be read, or has a bad range, would let
+	   addresses through, so the pattern doesn't compile */
+	for _, pattern := range []string{
+		"%{IP:client !@cidr file:" + ranges.Name() + ".missing}",
+		"%{IP:client !@cidr {10.0.0.0/8, 10.0.0.0/33}}",
+		"%{IP:client !@cidr {10.0.0.0/8, 300.0.0.1}}",
+		"%{IP:client !@cidr 10.0.0.0/8}",
+	} {
+		if err := g.Compile(pattern, false); err == nil || !strings.Contains(err.Error(), "Invalid @cidr predicate") {
+			t.Fatalf("%s: expected an invalid predicate, got %v", pattern, err)
+		}
+	}
+}
+
+func TestDiscoverSpans(t *testing.T) {
+	g := New()
+	defer g.Free()
+	g.AddPattern("KV", "(?<![A-Za-z0-9_])[A-Za-z0-9_]+=[0-9](?![0-9])")
+	g.AddPattern("PAIR", "(?<![A-Za-z0-9_])[A-Za-z0-9_]+=[0-9] [A-Za-z0-9_]+")
+
+	/* PAIR's "foo=1 bar" is the longest span, but taking it leaves no room
+	   for "bar=2"; two KVs together cover more of the line */
+	text := "foo=1 bar=2"
+	expected := "\\Q\\E%{KV}\\Q \\E%{KV}\\Q\\E"
+	if discovery := g.Discover(text); discovery != expected {
+		t.Fatalf("Expected %q, got %q", expected, discovery)
+	}
+
+	/* A \E in literal text must not end the quoting early */
+	tests := []struct {
+		text, expected string
+	}{
+		{"a\\Eb foo=1 \\E", "\\Qa\\E\\\\E\\Qb \\E%{KV}\\Q \\E\\\\E\\Q\\E"},
+		{"x\\\\E foo=1 \\", "\\Qx\\\\E\\\\E\\Q \\E%{KV}\\Q \\\\E"},
+	}
+	for _, test := range tests {
+		discovery := g.Discover(test.text)
+		if discovery != test.expected {
+			t.Fatalf("Expected %q, got %q", test.expected, discovery)
+		}
+		if err := g.Compile("^"+discovery+"$", false); err != nil {
+			t.Fatalf("%q: %s", discovery, err)
+		}
+		match := g.Match(test.text)
+		if match == nil {
+			t.Fatalf("%q doesn't match %q", discovery, test.text)
+		}
+		if value := match.Captures()["KV"][0]; value != "foo=1" {
+			t.Fatalf("Expected %q, got %q", "foo=1", value)
+		}
+	}
+
+	/* Predicates in the library still apply to the spans discovery finds */
+	p := New()
+	defer p.Free()
+	p.AddPattern("DIGIT", "[0-9]")
+	p.AddPattern("LOWKV", "(?<![A-Za-z0-9_])[A-Za-z0-9_]+=%{DIGIT:d < 5}(?![0-9])")
+	expected = "\\Q\\E%{LOWKV}\\Q bar=7\\E"
+	if discovery := p.Discover("foo=1 bar=7"); discovery != expected {
+		t.Fatalf("Expected %q, got %q", expected, discovery)
+	}
+}
+
+func TestMatchBytes(t *testing.T) {
+	g := New()
+	defer g.Free()
+
+	g.AddPatternsFromFile("../patterns/base")
+	g.Compile("%{WORD:verb} %{NOTSPACE:path}(?: HTTP/%{NUMBER:version})?", true)
+
+	buf := []byte("GET /index.html HTTP/1.1")
+	if !g.MatchBytes(buf) {
+		t.Fatal("Expected a match")
+	}
+	if g.MatchBytes([]byte("!!!")) || g.MatchBytes(nil) {
+		t.Fatal("Expected no match")
+	}
+
+	want := g.Match(string(buf)).Captures()
+	captures := g.CapturesBytes(buf)
+	if len(captures) != len(want) {
+		t.Fatalf("Got captures %q, expected %q", captures, want)
+	}
+	for name, values := range want {
+		if len(captures[name]) != 1 || string(captures[name][0]) != values[0] {
+			t.Fatalf("Capture %s is %q, expected %q", name, captures[name], values)
+		}
+	}
+
+	/* Captures are views of the buffer */
+	buf[0] = 'P'
+	if verb := string(captures["WORD:verb"][0]); verb != "PET" {
+		t.Fatalf("Expected the capture to follow the buffer, got %q", verb)
+	}
+
+	names := g.CapturesBytes([]byte("PUT /x"))
+	if names["NUMBER:version"][0] != nil {
+		t.Fatalf("Expected a nil capture for a group that didn't match, got %q", names["NUMBER:version"][0])
+	}
+
+	offsets := make([]int, 0, 16)
+	allocs := testing.AllocsPerRun(100, func() {
+		offsets = g.OffsetsBytes(buf, offsets)
+	})
+	if allocs != 0 {
+		t.Fatalf("OffsetsBytes allocated %v times per run", allocs)
+	}
+	if offsets[0] != 0 || offsets[1] != len(buf) {
+		t.Fatalf("Whole match is %v, expected [0 %d]", offsets[:2], len(buf))
+	}
+	for i, name := range g.CaptureNames() {
+		start, end := offsets[2+i*2], offsets[3+i*2]
+		if value := string(buf[start:end]); value != string(captures[name][0]) {
+			t.Fatalf("Offsets of %s give %q, expected %q", name, value, captures[name][0])
+		}
+	}
+	if g.OffsetsBytes([]byte("!!!"), offsets) != nil {
+		t.Fatal("Expected no offsets without a match")
+	}
+}
+
+func BenchmarkMatchBytes(b *testing.B) {
+	g := New()
+	defer g.Free()
+
+	g.AddPatternsFromFile("../patterns/base")
+	g.AddPattern("S3_REQUEST_LINE", "(?:%{WORD:verb} %{NOTSPACE:request}(?: HTTP/%{NUMBER:httpversion})?|%{DATA:rawrequest}) (?P<pcre_named>.*)")
+	text := []byte("1124412d476eb4e8c9b691cacfa51bb990eff8169c3337e0be688c1caf1bdaf0 releases.rocana.com [11/Apr/2015:03:27:40 +0000] 10.220.7.37 arn:aws:iam::368902385577:user/mark FC206D08A83F5300 REST.POST.UPLOADS scalingdata-0.7.0.tar.gz \"POST /releases.rocana.com/scalingdata-0.7.0.tar.gz?uploads HTTP/1.1\" 200 - 370 - 8 7 \"-\" \"S3Console/0.4\" -")
+	pattern := "%{WORD:owner} %{NOTSPACE:bucket} \\[%{HTTPDATE:timestamp}\\] %{IP:clientip} %{NOTSPACE:requester} %{NOTSPACE:request_id} %{NOTSPACE:operation} %{NOTSPACE:key} (?:\"%{S3_REQUEST_LINE}\"|-) (?:%{INT:response}|-) (?:-|%{NOTSPACE:error_code}) (?:%{INT:bytes}|-) (?:%{INT:object_size}|-) (?:%{INT:request_time_ms}|-) (?:%{INT:turnaround_time_ms}|-) (?:%{QS:referrer}|-) (?:\"?%{QS:agent}\"?|-) (?:-|%{NOTSPACE:version_id})"
+	g.Compile(pattern, true)
+	offsets := make([]int, 0, 64)
+	b.ReportAllocs()
+	for i := 0; i < b.N; i++ {
+		offsets = g.OffsetsBytes(text, offsets)
+	}
+}
+
+func TestMatchInto(t *testing.T) {
+	g := New()
+	defer g.Free()
+	g.AddPatternsFromFile("../patterns/base")
+	g.Compile("%{WORD:verb} %{NOTSPACE:path}", true)
+
+	h := New()
+	defer h.Free()
+	h.AddPatternsFromFile("../patterns/base")
+	h.Compile("%{IP:a} %{IP:b} %{IP:c} %{IP:d} %{IP:e}", true)
+
+	match := new(Match)
+	defer match.Free()
+
+	texts := []string{"GET /", "POST /a/much/longer/path/than/before", "!!!", "PUT /b"}
+	for _, text := range texts {
+		want := g.Match(text)
+		if !g.MatchInto(match, text) {
+			if want != nil {
+				t.Fatalf("MatchInto didn't match %q", text)
+			}
+			continue
+		}
+		if path, expected := match.Captures()["NOTSPACE:path"][0], want.Captures()["NOTSPACE:path"][0]; path != expected {
+			t.Fatalf("Path of %q is %q, expected %q", text, path, expected)
+		}
+		want.Free()
+	}
+
+	/* A different Grok with more captures */
+	text := "1.1.1.1 2.2.2.2 3.3.3.3 4.4.4.4 5.5.5.5"
+	if !h.MatchInto(match, text) {
+		t.Fatal("Expected a match")
+	}
+	if e := match.Captures()["IP:e"][0]; e != "5.5.5.5" {
+		t.Fatalf("Expected 5.5.5.5, got %q", e)
+	}
+
+	/* The iterator works on a reused Match without allocating */
+	allocs := testing.AllocsPerRun(100, func() {
+		if !g.MatchInto(match, "GET /index.html") {
+			t.Fatal("Expected a match")
+		}
+		match.StartIterator()
+		for match.Next() {
+			match.Group()
+		}
+		match.EndIterator()
+	})
+	if allocs != 0 {
+		t.Fatalf("MatchInto allocated %v times per run", allocs)
+	}
+	if path := match.Captures()["NOTSPACE:path"][0]; path != "/index.html" {
+		t.Fatalf("Expected /index.html, got %q", path)
+	}
+}
+
+func BenchmarkMatchInto(b *testing.B) {
+	g := New()
+	defer g.Free()
+
+	g.AddPatternsFromFile("../patterns/base")
+	g.AddPattern("S3_REQUEST_LINE", "(?:%{WORD:verb} %{NOTSPACE:request}(?: HTTP/%{NUMBER:httpversion})?|%{DATA:rawrequest}) (?P<pcre_named>.*)")
+	text := "1124412d476eb4e8c9b691cacfa51bb990eff8169c3337e0be688c1caf1bdaf0 releases.rocana.com [11/Apr/2015:03:27:40 +0000] 10.220.7.37 arn:aws:iam::368902385577:user/mark FC206D08A83F5300 REST.POST.UPLOADS scalingdata-0.7.0.tar.gz \"POST /releases.rocana.com/scalingdata-0.7.0.tar.gz?uploads HTTP/1.1\" 200 - 370 - 8 7 \"-\" \"S3Console/0.4\" -"
+	pattern := "%{WORD:owner} %{NOTSPACE:bucket} \\[%{HTTPDATE:timestamp}\\] %{IP:clientip} %{NOTSPACE:requester} %{NOTSPACE:request_id} %{NOTSPACE:operation} %{NOTSPACE:key} (?:\"%{S3_REQUEST_LINE}\"|-) (?:%{INT:response}|-) (?:-|%{NOTSPACE:error_code}) (?:%{INT:bytes}|-) (?:%{INT:object_size}|-) (?:%{INT:request_time_ms}|-) (?:%{INT:turnaround_time_ms}|-) (?:%{QS:referrer}|-) (?:\"?%{QS:agent}\"?|-) (?:-|%{NOTSPACE:version_id})"
+	g.Compile(pattern, true)
+	pool := sync.Pool{New: func() interface{} { return new(Match) }}
+	b.ReportAllocs()
+	for i := 0; i < b.N; i++ {
+		m := pool.Get().(*Match)
+		g.MatchInto(m, text)
+		m.StartIterator()
+		for m.Next() {
+			m.Group()
+		}
+		m.EndIterator()
+		pool.Put(m)
+	}
+}
+
+func TestScan(t *testing.T) {
+	g := New()
+	defer g.Free()
+	g.AddPatternsFromFile("../patterns/base")
+	g.Compile("^%{WORD:verb} %{NOTSPACE:path}$", true)
+
+	long := strings.Repeat("x", 3*scanBufferSize)
+	input := "GET /a\r\nnot a request\n\nPUT /" + long + "\nPOST /c"
+	want := map[int]string{1: "/a", 4: "/" + long, 5: "/c"}
+
+	got := make(map[int]string)
+	err := g.Scan(strings.NewReader(input), func(lineNo int, m *Match) {
+		got[lineNo] = m.Captures()["NOTSPACE:path"][0]
+	})
+	if err != nil {
+		t.Fatal(err)
+	}
+	if len(got) != len(want) {
+		t.Fatalf("Matched lines %v, expected %v", len(got), len(want))
+	}
+	for lineNo, path := range want {
+		if got[lineNo] != path {
+			t.Fatalf("Line %d captured %.20q, expected %.20q", lineNo, got[lineNo], path)
+		}
+	}
+
+	empty := New()
+	defer empty.Free()
+	if err := empty.Scan(strings.NewReader(input), nil); err == nil {
+		t.Fatal("Expected an error scanning without a pattern")
+	}
+}
+
+/* Lines for the Scan benchmarks, one in three matching */
+func scanInput() string {
+	var lines []string
+	for i := 0; i < 30000; i++ {
+		switch i % 3 {
+		case 0:
+			lines = append(lines, fmt.Sprintf("GET /static/img%d.png HTTP/1.1", i))
+		case 1:
+			lines = append(lines, fmt.Sprintf("connection %d closed by peer", i))
+		case 2:
+			lines = append(lines, fmt.Sprintf("POST /api/v1/items/%d HTTP/1.0", i))
+		}
+	}
+	return strings.Join(lines, "\n") + "\n"
+}
+
+func BenchmarkScan(b *testing.B) {
+	g := New()
+	defer g.Free()
+	g.AddPatternsFromFile("../patterns/base")
+	g.Compile("^%{WORD:verb} %{NOTSPACE:path} HTTP/%{NUMBER:version}$", true)
+	input := scanInput()
+	b.SetBytes(int64(len(input)))
+	b.ResetTimer()
+	for i := 0; i < b.N; i++ {
+		g.Scan(strings.NewReader(input), func(lineNo int, m *Match) {})
+	}
+}
+
+func BenchmarkScanLines(b *testing.B) {
+	g := New()
+	defer g.Free()
+	g.AddPatternsFromFile("../patterns/base")
+	g.Compile("^%{WORD:verb} %{NOTSPACE:path} HTTP/%{NUMBER:version}$", true)
+	input := scanInput()
+	b.SetBytes(int64(len(input)))
+	b.ResetTimer()
+	for i := 0; i < b.N; i++ {
+		scanner := bufio.NewScanner(strings.NewReader(input))
+		for scanner.Scan() {
+			if m := g.Match(scanner.Text()); m != nil {
+				m.Free()
+			}
+		}
+	}
+}
+
+func TestMatchParallel(t *testing.T) {
+	g := New()
+	defer g.Free()
+	g.AddPatternsFromFile("../patterns/base")
+	g.Compile("^%{WORD:verb} %{NOTSPACE:path}(?: HTTP/%{NUMBER:version})?$", true)
+
+	lines := strings.Split(strings.TrimSuffix(scanInput(), "\n"), "\n")[:1000]
+	names := g.CaptureNames()
+	var out []Result
+	for _, workers := range []int{1, 3, 16, 0} {
+		out = g.MatchParallel(lines, workers, out)
+		if len(out) != len(lines) {
+			t.Fatalf("Got %d results for %d lines", len(out), len(lines))
+		}
+		for i, line := range lines {
+			want := g.Match(line)
+			if out[i].Matched != (want != nil) {
+				t.Fatalf("Line %q matched %v with %d workers", line, out[i].Matched, workers)
+			}
+			if want == nil {
+				continue
+			}
+			captures := want.Captures()
+			for j, name := range names {
+				start, end := out[i].Offsets[2+j*2], out[i].Offsets[3+j*2]
+				value := ""
+				if start >= 0 {
+					value = line[start:end]
+				}
+				if value != captures[name][0] {
+					t.Fatalf("Line %q capture %s is %q, expected %q", line, name, value, captures[name][0])
+				}
+			}
+			want.Free()
+		}
+	}
+
+	allocs := testing.AllocsPerRun(10, func() {
+		out = g.MatchParallel(lines, 1, out)
+	})
+	if allocs > 10 {
+		t.Fatalf("MatchParallel into a used out allocated %v times for %d lines", allocs, len(lines))
+	}
+	if out = g.MatchParallel(nil, 4, out); len(out) != 0 {
+		t.Fatalf("Expected no results for no lines, got %d", len(out))
+	}
+}
+
+func BenchmarkMatchParallel(b *testing.B) {
+	g := New()
+	defer g.Free()
+
+	g.AddPatternsFromFile("../patterns/base")
+	g.AddPattern("S3_REQUEST_LINE", "(?:%{WORD:verb} %{NOTSPACE:request}(?: HTTP/%{NUMBER:httpversion})?|%{DATA:rawrequest}) (?P<pcre_named>.*)")
+	text := "1124412d476eb4e8c9b691cacfa51bb990eff8169c3337e0be688c1caf1bdaf0 releases.rocana.com [11/Apr/2015:03:27:40 +0000] 10.220.7.37 arn:aws:iam::368902385577:user/mark FC206D08A83F5300 REST.POST.UPLOADS scalingdata-0.7.0.tar.gz \"POST /releases.rocana.com/scalingdata-0.7.0.tar.gz?uploads HTTP/1.1\" 200 - 370 - 8 7 \"-\" \"S3Console/0.4\" -"
+	pattern := "%{WORD:owner} %{NOTSPACE:bucket} \\[%{HTTPDATE:timestamp}\\] %{IP:clientip} %{NOTSPACE:requester} %{NOTSPACE:request_id} %{NOTSPACE:operation} %{NOTSPACE:key} (?:\"%{S3_REQUEST_LINE}\"|-) (?:%{INT:response}|-) (?:-|%{NOTSPACE:error_code}) (?:%{INT:bytes}|-) (?:%{INT:object_size}|-) (?:%{INT:request_time_ms}|-) (?:%{INT:turnaround_time_ms}|-) (?:%{QS:referrer}|-) (?:\"?%{QS:agent}\"?|-) (?:-|%{NOTSPACE:version_id})"
+	g.Compile(pattern, true)
+	lines := make([]string, 4096)
+	for i := range lines {
+		lines[i] = text
+	}
+	out := g.MatchParallel(lines, 0, nil)
+	b.SetBytes(int64(len(text) * len(lines)))
+	b.ResetTimer()
+	for i := 0; i < b.N; i++ {
+		out = g.MatchParallel(lines, 0, out)
+	}
+}
+
+//go:generate go run ./cmd/grokbind -type s3Access -output bind_test.go
+
+/* An S3 access log line, filled by the generated s3AccessBinder */
+type s3Access struct {
+	Bucket      string  `grok:"NOTSPACE:bucket"`
+	ClientIP    string  `grok:"clientip"`
+	Response    int     `grok:"INT:response"`
+	Bytes       int64   `grok:"INT:bytes"`
+	ObjectSize  uint32  `grok:"object_size"`
+	HTTPVersion float64 `grok:"NUMBER:httpversion"`
+	Agent       string  `grok:"QS:agent"`
+}
+
+func s3Grok() *Grok {
+	g := New()
+	g.AddPatternsFromFile("../patterns/base")
+	g.AddPattern("S3_REQUEST_LINE", "(?:%{WORD:verb} %{NOTSPACE:request}(?: HTTP/%{NUMBER:httpversion})?|%{DATA:rawrequest})")
+	pattern := "%{WORD:owner} %{NOTSPACE:bucket} \\[%{HTTPDATE:timestamp}\\] %{IP:clientip} %{NOTSPACE:requester} %{NOTSPACE:request_id} %{NOTSPACE:operation} %{NOTSPACE:key} (?:\"%{S3_REQUEST_LINE}\"|-) (?:%{INT:response}|-) (?:-|%{NOTSPACE:error_code}) (?:%{INT:bytes}|-) (?:%{INT:object_size}|-) (?:%{INT:request_time_ms}|-) (?:%{INT:turnaround_time_ms}|-) (?:%{QS:referrer}|-) (?:\"?%{QS:agent}\"?|-) (?:-|%{NOTSPACE:version_id})"
+	g.Compile(pattern, true)
+	return g
+}
+
+const s3Line = "1124412d476eb4e8c9b691cacfa51bb990eff8169c3337e0be688c1caf1bdaf0 releases.rocana.com [11/Apr/2015:03:27:40 +0000] 10.220.7.37 arn:aws:iam::368902385577:user/mark FC206D08A83F5300 REST.POST.UPLOADS scalingdata-0.7.0.tar.gz \"POST /releases.rocana.com/scalingdata-0.7.0.tar.gz?uploads HTTP/1.1\" 200 - 370 - 8 7 \"-\" \"S3Console/0.4\" -"
+
+func TestBinder(t *testing.T) {
+	g := s3Grok()
+	defer g.Free()
+
+	binder, err := newS3AccessBinder(g)
+	if err != nil {
+		t.Fatal(err)
+	}
+
+	var access s3Access
+	if ok, err := binder.Bind(s3Line, &access); !ok || err != nil {
+		t.Fatalf("Bind returned %v, %v", ok, err)
+	}
+	want := s3Access{
+		Bucket:      "releases.rocana.com",
+		ClientIP:    "10.220.7.37",
+		Response:    200,
+		Bytes:       370,
+		HTTPVersion: 1.1,
+		Agent:       "\"S3Console/0.4\"",
+	}
+	if access != want {
+		t.Fatalf("Bound %+v, expected %+v", access, want)
+	}
+
+	allocs := testing.AllocsPerRun(100, func() {
+		binder.Bind(s3Line, &access)
+	})
+	if allocs != 0 {
+		t.Fatalf("Bind allocated %v times per run", allocs)
+	}
+
+	if ok, _ := binder.Bind("nothing like an access log", &access); ok {
+		t.Fatal("Expected no match")
+	}
+	bad := strings.Replace(s3Line, "- 370 -", "- 99999999999999999999 -", 1)
+	if _, err := binder.Bind(bad, &access); err == nil {
+		t.Fatal("Expected an error binding an out of range integer")
+	}
+
+	other := New()
+	defer other.Free()
+	other.AddPatternsFromFile("../patterns/base")
+	other.Compile("%{NOTSPACE:bucket}", true)
+	if _, err := newS3AccessBinder(other); err == nil {
+		t.Fatal("Expected an error binding a Grok without the captures")
+	}
+}
+
+func BenchmarkBinder(b *testing.B) {
+	g := s3Grok()
+	defer g.Free()
+	binder, _ := newS3AccessBinder(g)
+	var access s3Access
+	b.ReportAllocs()
+	for i := 0; i < b.N; i++ {
+		binder.Bind(s3Line, &access)
+	}
+}
+
+/* The same as BenchmarkBinder, through Captures */
+func BenchmarkBinderCaptures(b *testing.B) {
+	g := s3Grok()
+	defer g.Free()
+	var access s3Access
+	b.ReportAllocs()
+	for i := 0; i < b.N; i++ {
+		m := g.Match(s3Line)
+		captures := m.Captures()
+		access.Bucket = captures["NOTSPACE:bucket"][0]
+		access.ClientIP = captures["IP:clientip"][0]
+		n, _ := strconv.ParseInt(captures["INT:response"][0], 10, 0)
+		access.Response = int(n)
+		access.Bytes, _ = strconv.ParseInt(captures["INT:bytes"][0], 10, 64)
+		access.HTTPVersion, _ = strconv.ParseFloat(captures["NUMBER:httpversion"][0], 64)
+		access.Agent = captures["QS:agent"][0]
+		m.Free()
+	}
+}
+
+/* A family of log lines in testdata, and a pattern for it. About one line
+   in ten of each corpus is noise the pattern shouldn't match, and the Java
+   corpus mixes stack frames with exception lines. */
+type benchCorpus struct {
+	name    string
+	file    string
+	pattern string
+}
+
+const s3RequestLine = "(?:%{WORD:verb} %{NOTSPACE:request}(?: HTTP/%{NUMBER:httpversion})?|%{DATA:rawrequest})"
+
+var benchCorpora = []benchCorpus{
+	{"apache", "apache.log", "%{COMBINEDAPACHELOG}"},
+	{"syslog_rfc3164", "syslog_rfc3164.log", "%{SYSLOGBASE} %{GREEDYDATA:message}"},
+	{"syslog_rfc5424", "syslog_rfc5424.log", "<%{POSINT:pri}>%{POSINT:version} %{TIMESTAMP_ISO8601:timestamp} %{HOSTNAME:host} %{NOTSPACE:app} %{NOTSPACE:procid} %{NOTSPACE:msgid} (?:-|\\[[^\\]]*\\]) %{GREEDYDATA:message}"},
+	{"nginx_error", "nginx_error.log", "%{YEAR}/%{MONTHNUM}/%{MONTHDAY} %{TIME} \\[%{WORD:level}\\] %{POSINT:pid}#%{INT:tid}: (?:\\*%{INT:cid} )?%{GREEDYDATA:message}"},
+	{"s3_access", "s3_access.log", "%{WORD:owner} %{NOTSPACE:bucket} \\[%{HTTPDATE:timestamp}\\] %{IP:clientip} %{NOTSPACE:requester} %{NOTSPACE:request_id} %{NOTSPACE:operation} %{NOTSPACE:key} (?:\"%{S3_REQUEST_LINE}\"|-) (?:%{INT:response}|-) (?:-|%{NOTSPACE:error_code}) (?:%{INT:bytes}|-) (?:%{INT:object_size}|-) (?:%{INT:request_time_ms}|-) (?:%{INT:turnaround_time_ms}|-) (?:%{QS:referrer}|-) (?:\"?%{QS:agent}\"?|-) (?:-|%{NOTSPACE:version_id})"},
+	{"java_stacktrace", "java_stacktrace.log", "^\\s+at %{NOTSPACE:method}\\(%{NOTSPACE:file}:%{INT:line}\\)$"},
+}
+
+func (corpus benchCorpus) lines(tb testing.TB) []string {
+	data, err := ioutil.ReadFile("testdata/" + corpus.file)
+	if err != nil {
+		tb.Fatal(err)
+	}
+	return strings.Split(strings.TrimSuffix(string(data), "\n"), "\n")
+}
+
+func (corpus benchCorpus) grok(tb testing.TB) *Grok {
+	g := New()
+	g.AddPatternsFromFile("../patterns/base")
+	g.AddPattern("S3_REQUEST_LINE", s3RequestLine)
+	if err := g.Compile(corpus.pattern, false); err != nil {
+		tb.Fatal(err)
+	}
+	return g
+}
+
+/* Check that each corpus pattern matches at least half its own corpus and none
+   of the next one, which the Miss benchmarks rely on */
+func TestCorpora(t *testing.T) {
+	for i, corpus := range benchCorpora {
+		g := corpus.grok(t)
+		matched := 0
+		for _, line := range corpus.lines(t) {
+			if m := g.Match(line); m != nil {
+				matched++
+				m.Free()
+			}
+		}
+		if matched < 150 {
+			t.Errorf("%s matched %d of its lines", corpus.name, matched)
+		}
+		for _, line := range benchCorpora[(i+1)%len(benchCorpora)].lines(t) {
+			if m := g.Match(line); m != nil {
+				t.Errorf("%s matched a line of the next corpus: %q", corpus.name, line)
+				m.Free()
+			}
+		}
+		g.Free()
+	}
+}
+
+/* Benchmark each way of matching over each corpus. One op is one line, so
+   ns/op, B/op and allocs/op are per line; cgocalls/line and %matched are
+   reported alongside. Miss matches each pattern against the next corpus,
+   where nothing should match. */
+func BenchmarkCorpus(b *testing.B) {
+	pile := NewPile()
+	defer pile.Free()
+	pile.AddPatternsFromFile("../patterns/base")
+	pile.AddPattern("S3_REQUEST_LINE", s3RequestLine)
+	for _, corpus := range benchCorpora {
+		if err := pile.Compile(corpus.pattern, false); err != nil {
+			b.Fatal(err)
+		}
+	}
+
+	for i, corpus := range benchCorpora {
+		benchmarkCorpus(b, pile, corpus, benchCorpora[(i+1)%len(benchCorpora)].lines(b))
+	}
+}
+
+/* The BenchmarkCorpus runs for one corpus, with the Pile holding every
+   corpus's pattern */
+func benchmarkCorpus(b *testing.B, pile *Pile, corpus benchCorpus, misses []string) {
+	lines := corpus.lines(b)
+	g := corpus.grok(b)
+	defer g.Free()
+	discoverer := g.NewDiscoverer()
+	defer discoverer.Free()
+
+	ops := []struct {
+		name  string
+		lines []string
+		fn    func(line string) bool
+	}{
+		{"Match", lines, func(line string) bool {
+			m := g.Match(line)
+			if m == nil {
+				return false
+			}
+			m.Free()
+			return true
+		}},
+		{"Miss", misses, func(line string) bool {
+			m := g.Match(line)
+			if m == nil {
+				return false
+			}
+			m.Free()
+			return true
+		}},
+		{"Captures", lines, func(line string) bool {
+			m := g.Match(line)
+			if m == nil {
+				return false
+			}
+			m.Captures()
+			m.Free()
+			return true
+		}},
+		{"Iterator", lines, func(line string) bool {
+			m := g.Match(line)
+			if m == nil {
+				return false
+			}
+			m.StartIterator()
+			for m.Next() {
+				m.Group()
+			}
+			m.EndIterator()
+			m.Free()
+			return true
+		}},
+		{"Pile", lines, func(line string) bool {
+			_, m := pile.Match(line)
+			if m == nil {
+				return false
+			}
+			m.Free()
+			return true
+		}},
+		{"Discover", lines, func(line string) bool {
+			return discoverer.Discover(line) != ""
+		}},
+	}
+
+	for _, op := range ops {
+		b.Run(corpus.name+"/"+op.name, func(b *testing.B) {
+			matched := 0
+			b.ReportAllocs()
+			cgoCalls := runtime.NumCgoCall()
+			b.ResetTimer()
+			for i := 0; i < b.N; i++ {
+				if op.fn(op.lines[i%len(op.lines)]) {
+					matched++
+				}
+			}
+			b.StopTimer()
+			b.ReportMetric(float64(runtime.NumCgoCall()-cgoCalls)/float64(b.N), "cgocalls/line")
+			b.ReportMetric(100*float64(matched)/float64(b.N), "%matched")
+		})
+	}
+
+}
+
+func TestDiscoverer(t *testing.T) {
+	g := New()
+	defer g.Free()
+	g.AddPatternsFromFile("../patterns/base")
+
+	d := g.NewDiscoverer()
+	defer d.Free()
+
+	lines := []string{
+		"1.2.3.4 - - GET /index.html 200",
+		"user bob logged in from 10.0.0.1",
+		"took 250 ms to reach example.com",
+		"a \\E in 10/Oct/2000:13:55:36 -0700 text",
+	}
+	expected := make([]string, len(lines))
+	for i, line := range lines {
+		expected[i] = d.Discover(line)
+		if expected[i] != g.Discover(line) {
+			t.Fatalf("Discoverer and Grok.Discover disagree on %q", line)
+		}
+
+		/* The discovered pattern matches the whole line it came from */
+		if err := g.Compile("^"+expected[i]+"$", false); err != nil {
+			t.Fatalf("%q: %s", expected[i], err)
+		}
+		if match := g.Match(line); match == nil {
+			t.Fatalf("%q doesn't match %q", expected[i], line)
+		}
+	}
+	if expected[0] == "\\Q"+lines[0]+"\\E" {
+		t.Fatalf("Expected to discover something in %q", lines[0])
+	}
+
+	var wg sync.WaitGroup
+	for i := 0; i < 8; i++ {
+		wg.Add(1)
+		go func() {
+			defer wg.Done()
+			for j := 0; j < 50; j++ {
+				k := j % len(lines)
+				if discovery := d.Discover(lines[k]); discovery != expected[k] {
+					t.Errorf("Expected %q, got %q", expected[k], discovery)
+					return
+				}
+			}
+		}()
+	}
+	wg.Wait()
+}
+
+func TestDiscoverCorpus(t *testing.T) {
+	g := New()
+	defer g.Free()
+	g.AddPatternsFromFile("../patterns/base")
+
+	d := g.NewDiscoverer()
+	defer d.Free()
+
+	lines := make([]string, 0)
+	for i := 0; i < 30; i++ {
+		lines = append(lines, fmt.Sprintf("GET /index.html from 10.0.0.%d", i%3))
+		lines = append(lines, fmt.Sprintf("took %d ms at 10/Oct/2000:13:55:36 -0700", i))
+	}
+	lines = append(lines, "something else entirely")
+
+	results := d.DiscoverCorpus(lines, 4)
+	total := 0
+	for _, result := range results {
+		total += result.Lines
+		if result.Matched < 1 || result.Matched > result.Lines {
+			t.Fatalf("Bad coverage %d/%d for %q", result.Matched, result.Lines, result.Pattern)
+		}
+		if discovery := d.Discover(lines[result.Representative]); discovery != result.Pattern {
+			t.Fatalf("Expected %q for line %d, got %q", discovery, result.Representative, result.Pattern)
+		}
+	}
+	if total != len(lines) {
+		t.Fatalf("Expected results to cover %d lines, got %d", len(lines), total)
+	}
+
+	/* The IP addresses differ only in digits, so the first lines share a
+	   shape and the most common pattern covers all of them */
+	if results[0].Lines != 30 || results[0].Matched != 30 || results[0].Representative != 0 {
+		t.Fatalf("Expected the first pattern to cover lines 0..29, got %+v", results[0])
+	}
+	if len(d.DiscoverCorpus(nil, 0)) != 0 {
+		t.Fatal("Expected no results for no lines")
+	}
+}
+
+func TestStreamDiscoverer(t *testing.T) {
+	p := NewPile()
+	defer p.Free()
+	p.AddPatternsFromFile("../patterns/base")
+	p.Compile("^took %{INT:ms} ms$", false)
+
+	sd, err := p.NewStreamDiscoverer(4)
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer sd.Free()
+
+	input := ""
+	for i := 0; i < 6; i++ {
+		input += fmt.Sprintf("took %d ms\n", i)
+		input += "GET /index.html from 10.0.0.1\n"
+	}
+
+	matched := make([]int, 0)
+	err = sd.Process(strings.NewReader(input), func(line string, grok *Grok, match *Match) {
+		if grok == nil {
+			matched = append(matched, -1)
+			return
+		}
+		for i, g := range p.Groks {
+			if g == grok {
+				matched = append(matched, i)
+			}
+		}
+		match.Free()
+	})
+	if err != nil {
+		t.Fatal(err)
+	}
+
+	/* Three unknown lines are buffered, the fourth fills the buffer and is
+	   matched by the learned pattern, as are the rest */
+	expected := []int{0, -1, 0, -1, 0, -1, 0, 1, 0, 1, 0, 1}
+	if fmt.Sprint(matched) != fmt.Sprint(expected) {
+		t.Fatalf("Expected %v, got %v", expected, matched)
+	}
+	if learned := sd.Learned(); len(learned) != 1 || len(p.Groks) != 2 {
+		t.Fatalf("Expected one learned pattern, got %q", learned)
+	}
+	if added := sd.Learn(); len(added) != 0 {
+		t.Fatalf("Expected nothing new to learn, got %q", added)
+	}
+}
+
+func TestStreamDiscovererLiterals(t *testing.T) {
+	p := NewPile()
+	defer p.Free()
+	p.AddPatternsFromFile("../patterns/base")
+	p.Compile("^took %{INT:ms} ms$", false)
+
+	sd, err := p.NewStreamDiscoverer(2)
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer sd.Free()
+
+	/* Patterns are added to the shared library while learning */
+	done := make(chan bool)
+	go func() {
+		for i := 0; i < 200; i++ {
+			p.AddPattern(fmt.Sprintf("EXTRA%d", i), "x+")
+		}
+		done <- true
+	}()
+
+	/* Discovery finds nothing in these, and learning each one verbatim
+	   would only add a Grok per line */
+	for i := 0; i < 50; i++ {
+		for _, line := range []string{"something else entirely", "-- --", "?!"} {
+			if grok, match := sd.Match(line); grok != nil {
+				match.Free()
+				t.Fatalf("Expected no match for %q", line)
+			}
+		}
+		if grok, match := sd.Match("user bob from 10.0.0.1"); grok != nil {
+			match.Free()
+		}
+	}
+	<-done
+
+	learned := sd.Learned()
+	for _, pattern := range learned {
+		if !strings.Contains(pattern, "%{") {
+			t.Fatalf("Learned literal pattern %q", pattern)
+		}
+	}
+	if len(learned) != 1 || len(p.Groks) != 2 {
+		t.Fatalf("Expected one learned pattern, got %q", learned)
+	}
+}
+
+func TestTemplateMiner(t *testing.T) {
+	g := New()
+	defer g.Free()
+	g.AddPatternsFromFile("../patterns/base")
+
+	miner := g.NewTemplateMiner(2, 0.4)
+	defer miner.Free()
+
+	lines := make([]string, 0)
+	for i := 0; i < 20; i++ {
+		lines = append(lines, fmt.Sprintf("Connection from 10.0.0.%d port %d", i, 40000+i))
+		lines = append(lines, fmt.Sprintf("user u%d logged in after %d.5 s", i%3, i))
+		lines = append(lines, fmt.Sprintf("cache(x) (%s) hit", []string{"l1", "l2"}[i%2]))
+	}
+	for i, line := range lines {
+		if template := miner.Add(line); template != i%3 {
+			t.Fatalf("Expected %q to go to template %d, got %d", line, i%3, template)
+		}
+	}
+
+	expected := []Template{
+		{"Connection\\s+from\\s+%{IP}\\s+port\\s+%{INT}", 20},
+		{"user\\s+%{WORD}\\s+logged\\s+in\\s+after\\s+%{NUMBER}\\s+s", 20},
+		{"cache\\(x\\)\\s+%{NOTSPACE}\\s+hit", 20},
+	}
+	templates := miner.Templates()
+	if fmt.Sprint(templates) != fmt.Sprint(expected) {
+		t.Fatalf("Expected %v, got %v", expected, templates)
+	}
+
+	/* Templates compile, and match the lines they came from */
+	for i, line := range lines {
+		if err := g.Compile(templates[i%3].Pattern, false); err != nil {
+			t.Fatal(err)
+		}
+		if match := g.Match(line); match == nil {
+			t.Fatalf("%q doesn't match %q", templates[i%3].Pattern, line)
+		}
+	}
+}
@@ -14,21 +14,30 @@
 #include "stringhelper.h"
 
 /* internal functions */
-static char *grok_pattern_expand(grok_t *grok, int only_renamed); //, int offset, int length);
+static char *grok_pattern_expand(grok_t *grok, const char *pattern,
+                                 int pattern_len, int only_renamed,
+                                 int match_only, int *expanded_len);
 static void grok_study_capture_map(grok_t *grok, int only_renamed);
+static void grok_study_predicates(grok_t *grok);
 
-static void grok_capture_add_predicate(grok_t *grok, int capture_id,
-                                       const char *predicate, int predicate_len, int renamed_only);
+static int grok_capture_add_predicate(grok_t *grok, int capture_id,
+                                      const char *predicate, int predicate_len, int renamed_only);
 
 void grok_free_clone(const grok_t *grok) {
   if (grok->re != NULL) {
     pcre_free(grok->re);
   }
 
+  if (grok->re_extra != NULL) {
+    pcre_free(grok->re_extra);
+  }
+
   if (grok->full_pattern != NULL) {
     free(grok->full_pattern);
   }
 
+  free(grok->predicates);
+
   if (grok->captures_by_name != NULL) {
     tctreedel(grok->captures_by_name);
   }
@@ -66,15 +75,36 @@ int grok_compilen(grok_t *grok, const char *pattern, int length, int only_rename
   tctreeclear(grok->captures_by_capture_number);
   tctreeclear(grok->captures_by_id);
 
+  /* drop anything left over from a previous compile */
+  if (grok->re != NULL) {
+    pcre_free(grok->re);
+    grok->re = NULL;
+  }
+  if (grok->re_extra != NULL) {
+    pcre_free(grok->re_extra);
+    grok->re_extra = NULL;
+  }
+  if (grok->full_pattern != NULL) {
+    free(grok->full_pattern);
+    grok->full_pattern = NULL;
+  }
+  free(grok->predicates);
+  grok->predicates = NULL;
+  grok->npredicates = 0;
+
   grok->pattern = pattern;
   grok->pattern_len = length;
-  grok->full_pattern = grok_pattern_expand(grok, only_renamed);
+  grok->errstr = NULL;
+  grok->full_pattern = grok_pattern_expand(grok, pattern, length, only_renamed,
+                                           0, &grok->full_pattern_len);
 
   if (grok->full_pattern == NULL) {
     grok_log(grok, LOG_COMPILE, "A failure occurred while compiling '%.*s'",
              length, pattern);
-    grok->errstr = "failure occurred while expanding pattern "\
-                   "(too pattern recursion?)";
+    if (grok->errstr == NULL) {
+      grok->errstr = "failure occurred while expanding pattern "\
+                     "(too pattern recursion?)";
+    }
     return GROK_ERROR_COMPILE_FAILED;
   }
 
@@ -86,12 +116,19 @@ int grok_compilen(grok_t *grok, const char *pattern, int length, int only_rename
     return GROK_ERROR_COMPILE_FAILED;
   }
 
+  /* A study failure isn't fatal; we just run without the extra data */
+  grok->re_extra = pcre_study(grok->re, 0, &grok->pcre_errptr);
+  if (grok->re_extra == NULL && grok->pcre_errptr != NULL) {
+    grok_log(grok, LOG_COMPILE, "pcre_study failed: %s", grok->pcre_errptr);
+  }
+
   pcre_fullinfo(grok->re, NULL, PCRE_INFO_CAPTURECOUNT, &grok->pcre_num_captures);
   grok->pcre_num_captures++; /* include the 0th group */
 
   /* Walk grok->captures_by_id.
    * For each, ask grok->re what stringnum it is */
   grok_study_capture_map(grok, only_renamed);
+  grok_study_predicates(grok);
 
   return GROK_OK;
 }
@@ -100,14 +137,96 @@ const char * const grok_error(grok_t *grok) {
   return grok->errstr;
 }
 
+int grok_compile_stats(const grok_t *grok, grok_compile_stats_t *stats) {
+  unsigned long options = 0;
+  int value;
+
+  if (grok->re == NULL) {
+    return GROK_ERROR_UNINITIALIZED;
+  }
+
+  memset(stats, 0, sizeof(grok_compile_stats_t));
+  stats->pattern_len = grok->pattern_len;
+  stats->full_pattern_len = grok->full_pattern_len;
+  stats->expansions = grok->expansions;
+  stats->max_depth = grok->max_expand_depth;
+  stats->capture_count = grok->pcre_num_captures - 1;
+
+  pcre_fullinfo(grok->re, grok->re_extra, PCRE_INFO_SIZE, &stats->compiled_size);
+  pcre_fullinfo(grok->re, grok->re_extra, PCRE_INFO_STUDYSIZE, &stats->study_size);
+
+  pcre_fullinfo(grok->re, grok->re_extra, PCRE_INFO_FIRSTBYTE, &value);
+  stats->first_byte = (value < 0) ? value : (value & 0xff);
+  stats->first_byte_caseless = (value >= 0 && (value & PCRE_BYTE_CASELESS));
+
+  pcre_fullinfo(grok->re, grok->re_extra, PCRE_INFO_LASTLITERAL, &value);
+  stats->required_byte = (value < 0) ? value : (value & 0xff);
+  stats->required_byte_caseless = (value >= 0 && (value & PCRE_BYTE_CASELESS));
+
+  stats->has_start_bits = (grok->re_extra != NULL
+                           && (grok->re_extra->flags & PCRE_EXTRA_STUDY_DATA)
+                           && stats->first_byte == -2);
+  if (stats->has_start_bits) {
+    const unsigned char *table = NULL;
+    pcre_fullinfo(grok->re, grok->re_extra, PCRE_INFO_FIRSTTABLE, &table);
+    stats->has_start_bits = (table != NULL);
+  }
+
+  pcre_fullinfo(grok->re, grok->re_extra, PCRE_INFO_OPTIONS, &options);
+  stats->anchored = ((options & PCRE_ANCHORED) != 0);
+
+  return GROK_OK;
+}
+
 int grok_exec(const grok_t *grok, const char *text, grok_match_t *gm) {
   return grok_execn(grok, text, strlen(text), gm);
 }
 
 int grok_execn(const grok_t *grok, const char *text, int textlen, grok_match_t *gm) {
   int ret;
+  if (grok->re == NULL) {
+    grok_log(grok, LOG_EXEC, "Error: pcre re is null, meaning you haven't called grok_compile yet");
+    fprintf(stderr, "ERROR: grok_execn called on an object that has not pattern compiled. Did you call grok_compile yet?\n");
+    return GROK_ERROR_UNINITIALIZED;
+  }
+
+  /* Nothing to store, so don't bother with a capture vector unless a
+   * predicate needs to see the captures */
+  if (gm == NULL && grok->npredicates == 0) {
+    return grok_execn_vector(grok, text, textlen, NULL, 0);
+  }
+
+  int* matches = calloc(grok->pcre_num_captures * 3, sizeof(int));
+  ret = grok_execn_vector(grok, text, textlen, matches,
+                          grok->pcre_num_captures * 3);
+  if (ret != GROK_OK) {
+    free(matches);
+    return ret;
+  }
+
+  if (gm == NULL) {
+    free(matches);
+    return GROK_OK;
+  }
+
+  gm->grok = grok;
+  gm->subject = text;
+  gm->pcre_capture_vector = matches;
+  gm->start = matches[0];
+  gm->end = matches[1];
+  return GROK_OK;
+}
+
+int grok_execn_vector(const grok_t *grok, const char *text, int textlen,
+                      int *vector, int vector_size) {
+  int ret;
   pcre_extra pce;
-  pce.flags = PCRE_EXTRA_CALLOUT_DATA;
+  if (grok->re_extra != NULL) {
+    pce = *grok->re_extra;
+  } else {
+    pce.flags = 0;
+  }
+  pce.flags |= PCRE_EXTRA_CALLOUT_DATA;
   pce.callout_data = (void *)grok;
 
   if (grok->re == NULL) {
@@ -116,13 +235,10 @@ int grok_execn(const grok_t *grok, const char *text, int textlen, grok_match_t *
     return GROK_ERROR_UNINITIALIZED;
   }
 
-  int* matches = calloc(grok->pcre_num_captures * 3, sizeof(int));
-  ret = pcre_exec(grok->re, &pce, text, textlen, 0, 0,
-                  matches, grok->pcre_num_captures * 3);
+  ret = pcre_exec(grok->re, &pce, text, textlen, 0, 0, vector, vector_size);
   grok_log(grok, LOG_EXEC, "%.*s =~ /%s/ => %d",
            textlen, text, grok->pattern, ret);
   if (ret < 0) {
-    free(matches);
     switch (ret) {
       case PCRE_ERROR_NOMATCH:
         return GROK_ERROR_NOMATCH;
@@ -141,20 +257,20 @@ int grok_execn(const grok_t *grok, const char *text, int textlen, grok_match_t *
     return GROK_ERROR_PCRE_ERROR;
   }
 
-  /* Push match info into gm only if it is non-NULL */
-  if (gm != NULL) {
-    gm->grok = grok;
-    gm->subject = text;
-    gm->pcre_capture_vector = matches;
-    gm->start = matches[0];
-    gm->end = matches[1];
-  }
-
   return GROK_OK;
 }
 
-/* XXX: This method is pretty long; split it up? */
-static char *grok_pattern_expand(grok_t *grok, int renamed_only) {
+char *grok_expand_match_only(grok_t *grok, const char *pattern, int length,
+                             int *expanded_len) {
+  return grok_pattern_expand(grok, pattern, length, 0, 1, expanded_len);
+}
+
+/* XXX: This method is pretty long; split it up?
+ * With match_only set, %{FOO} becomes (?:regexp) and nothing about captures
+ * or predicates is recorded in grok. */
+static char *grok_pattern_expand(grok_t *grok, const char *pattern,
+                                 int pattern_len, int renamed_only,
+                                 int match_only, int *expanded_len) {
   int capture_id = 0; /* Starting capture_id, doesn't really matter what this is */
   int offset = 0; /* string offset; how far we've expanded so far */
   int *capture_vector = NULL;
@@ -167,11 +283,22 @@ static char *grok_pattern_expand(grok_t *grok, int renamed_only) {
 
   const char *patname = NULL;
 
+  /* End offsets of the expansions we are currently inside of, innermost
+   * last. Used to track how deeply %{FOO} patterns nest. */
+  int *depth_ends = NULL;
+  int depth = 0;
+  int depth_size = 0;
+
+  if (!match_only) {
+    grok->expansions = 0;
+    grok->max_expand_depth = 0;
+  }
+
   capture_vector = calloc(3 * g_pattern_num_captures, sizeof(int));
-  full_len = grok->pattern_len;
-  full_size = full_len;
+  full_len = pattern_len;
+  full_size = full_len + 1; /* room for the NUL terminator */
   full_pattern = calloc(1, full_size);
-  memcpy(full_pattern, grok->pattern, full_len);
+  memcpy(full_pattern, pattern, full_len);
   grok_log(grok, LOG_REGEXPAND, "% 20s: %.*s", "start of expand",
            full_len, full_pattern);
 
@@ -189,6 +316,7 @@ static char *grok_pattern_expand(grok_t *grok, int renamed_only) {
     replacement_count++;
     if (replacement_count > 500) {
       free(capture_vector);
+      free(depth_ends);
       free(full_pattern);
       grok->errstr = "Too many replacements have occurred (500), infinite recursion?";
       return NULL;
@@ -228,8 +356,22 @@ static char *grok_pattern_expand(grok_t *grok, int renamed_only) {
     
     /* Check for nullness again because there could've been an inline
      * definition found above */
-    if (pattern_regex != NULL) {
+    if (pattern_regex != NULL && match_only) {
+      if (capture_vector[g_cap_predicate * 2] >= 0) {
+        grok_log(grok, LOG_PREDICATE, "Ignoring predicate in '%.*s'",
+                 matchlen, full_pattern + start);
+      }
+
+      /* Replace %{FOO} with (?:pattern). '4' is strlen("(?:)") */
+      substr_replace(&full_pattern, &full_len, &full_size,
+                     start, end, "(?:)", 4);
+      substr_replace(&full_pattern, &full_len, &full_size,
+                     start + 3, 0, pattern_regex, regexp_len);
+      offset = start;
+    } else if (pattern_regex != NULL) {
       int has_predicate = (capture_vector[g_cap_predicate * 2] >= 0);
+      int len_before = full_len;
+      int i;
       const char *longname = NULL;
       const char *subname = NULL;
       grok_capture *gct = calloc(1, sizeof(grok_capture));;
@@ -250,13 +392,31 @@ static char *grok_pattern_expand(grok_t *grok, int renamed_only) {
       gct->subname = (char *)subname;
       gct->subname_len = strlen(gct->subname);
       grok_capture_add(grok, gct, renamed_only);
+      free(gct); /* the capture trees keep copies */
 
       //pcre_free_substring(longname);
       //pcre_free_substring(subname);
 
-      /* if a predicate was given, add (?C1) to callout when the match is made,
-       * so we can test it further */
-      if (has_predicate) {
+      /* if a predicate was given, add (?Cn) to callout when the match is made,
+       * so we can test it further. n is the predicate's index + 1 in
+       * grok->predicates; PCRE allows callout numbers up to 255. */
+      if (has_predicate && grok->npredicates >= 255) {
+        /* Dropping the predicate would make the pattern match more than it
+         * should, so refuse to compile it */
+        grok_log(grok, LOG_PREDICATE, "Too many predicates at '%.*s'",
+                 matchlen, full_pattern + start);
+        if (pattern_regex_needs_free) {
+          free((void *)pattern_regex);
+        }
+        pcre_free_substring(patname);
+        free(capture_vector);
+        free(depth_ends);
+        free(full_pattern);
+        grok->errstr = "Too many predicates (at most 255)";
+        return NULL;
+      } else if (has_predicate) {
+        char callout[16];
+        int callout_len;
         int pstart, pend;
         pstart = capture_vector[g_cap_predicate * 2];
         pend = capture_vector[g_cap_predicate * 2 + 1];
@@ -265,10 +425,31 @@ static char *grok_pattern_expand(grok_t *grok, int renamed_only) {
         grok_log(grok, LOG_REGEXPAND, "Predicate is: '%.*s'",
                  pend - pstart, full_pattern + pstart);
 
-        grok_capture_add_predicate(grok, capture_id, full_pattern + pstart,
-                                   pend - pstart, renamed_only);
+        if (grok_capture_add_predicate(grok, capture_id, full_pattern + pstart,
+                                       pend - pstart, renamed_only) != 0) {
+          /* Likewise, a predicate that can't be set up would let anything
+           * through; grok->errstr says why */
+          if (pattern_regex_needs_free) {
+            free((void *)pattern_regex);
+          }
+          pcre_free_substring(patname);
+          free(capture_vector);
+          free(depth_ends);
+          free(full_pattern);
+          return NULL;
+        }
+
+        /* Only the capture id is known until grok_study_predicates() */
+        grok->predicates = realloc(grok->predicates, (grok->npredicates + 1)
+                                   * sizeof(grok_capture));
+        grok_capture_init(grok, grok->predicates + grok->npredicates);
+        grok->predicates[grok->npredicates].id = capture_id;
+        grok->npredicates++;
+
+        callout_len = snprintf(callout, sizeof(callout), "(?C%d)",
+                               grok->npredicates);
         substr_replace(&full_pattern, &full_len, &full_size,
-                       end, 0, "(?C1)", 5);
+                       end, 0, callout, callout_len);
       }
 
       /* Replace %{FOO} with (?<>). '5' is strlen("(?<>)") */
@@ -296,6 +477,24 @@ static char *grok_pattern_expand(grok_t *grok, int renamed_only) {
 
       /* Invariant, full_pattern actual len must always be full_len */
       assert(strlen(full_pattern) == full_len);
+
+      /* Leave any expansions that ended before this one, then grow the
+       * ones enclosing it by however much this expansion added. */
+      while (depth > 0 && depth_ends[depth - 1] <= start) {
+        depth--;
+      }
+      for (i = 0; i < depth; i++) {
+        depth_ends[i] += full_len - len_before;
+      }
+      if (depth == depth_size) {
+        depth_size = (depth_size == 0) ? 8 : depth_size * 2;
+        depth_ends = realloc(depth_ends, depth_size * sizeof(int));
+      }
+      depth_ends[depth++] = end + (full_len - len_before);
+      if (depth > grok->max_expand_depth) {
+        grok->max_expand_depth = depth;
+      }
+      grok->expansions++;
       
       /* Move offset to the start of the regexp pattern we just injected.
        * This is so when we iterate again, we can process this new pattern
@@ -327,14 +526,16 @@ static char *grok_pattern_expand(grok_t *grok, int renamed_only) {
   grok_log(grok, LOG_REGEXPAND, "Fully expanded: %.*s", full_len, full_pattern);
 
   free(capture_vector);
-  grok->full_pattern_len = full_len;
-  grok->full_pattern = full_pattern;
+  free(depth_ends);
+  *expanded_len = full_len;
   return full_pattern;
 } /* grok_pattern_expand */
 
-static void grok_capture_add_predicate(grok_t *grok, int capture_id,
-                                       const char *predicate, int predicate_len,
-                                       int renamed_only) {
+/* Returns nonzero, with grok->errstr set, if a predicate that can only be
+ * checked once it is set up (like @in or @cidr) fails to set up */
+static int grok_capture_add_predicate(grok_t *grok, int capture_id,
+                                      const char *predicate, int predicate_len,
+                                      int renamed_only) {
   grok_capture *gct;
   int offset = 0;
 
@@ -344,7 +545,7 @@ static void grok_capture_add_predicate(grok_t *grok, int capture_id,
   gct = (grok_capture *)grok_capture_get_by_id(grok, capture_id);
   if (gct == NULL) {
     grok_log(grok, LOG_PREDICATE, "Failure to find capture id %d", capture_id);
-    return;
+    return 0;
   }
 
   /* Compile the predicate into something useful */
@@ -360,13 +561,28 @@ static void grok_capture_add_predicate(grok_t *grok, int capture_id,
   predicate_len -= offset;
 
   if (predicate_len > 2) {
-    if (!strncmp(predicate, "=~", 2) || !strncmp(predicate, "!~", 2)) {
+    if (!strncmp(predicate, "@in", 3) || !strncmp(predicate, "!@in", 4)) {
+      if (grok_predicate_in_init(grok, gct, predicate, predicate_len,
+                                 renamed_only) != 0) {
+        grok->errstr = "Invalid @in predicate (bad set or unreadable file)";
+        return 1;
+      }
+      return 0;
+    } else if (!strncmp(predicate, "@cidr", 5)
+               || !strncmp(predicate, "!@cidr", 6)) {
+      if (grok_predicate_cidr_init(grok, gct, predicate, predicate_len,
+                                   renamed_only) != 0) {
+        grok->errstr = "Invalid @cidr predicate (bad range or unreadable file)";
+        return 1;
+      }
+      return 0;
+    } else if (!strncmp(predicate, "=~", 2) || !strncmp(predicate, "!~", 2)) {
       grok_predicate_regexp_init(grok, gct, predicate, predicate_len, renamed_only);
-      return;
+      return 0;
     } else if ((predicate[0] == '$') 
                && (strchr("!<>=", predicate[1]) != NULL)) {
       grok_predicate_strcompare_init(grok, gct, predicate, predicate_len, renamed_only);
-      return;
+      return 0;
     }
   } 
   if (predicate_len > 1) {
@@ -382,6 +598,7 @@ static void grok_capture_add_predicate(grok_t *grok, int capture_id,
 
   /* update the database with our modified grok_capture */
   grok_capture_add(grok, gct, renamed_only);
+  return 0;
 }
 
 /* Parse the group name, up to the max length, and try to parse it as a hex number.
@@ -452,6 +669,23 @@ static void grok_study_capture_map(grok_t *grok, int only_renamed) {
   }
 }
 
+/* Copy each predicate's capture out of the capture trees, now that its pcre
+ * capture number is known, so the callout doesn't have to look it up */
+static void grok_study_predicates(grok_t *grok) {
+  int i;
+
+  for (i = 0; i < grok->npredicates; i++) {
+    const grok_capture *gct = grok_capture_get_by_id(grok,
+                                                     grok->predicates[i].id);
+    if (gct == NULL) {
+      grok_log(grok, LOG_PREDICATE, "No capture %d for predicate %d",
+               grok->predicates[i].id, i + 1);
+      continue;
+    }
+    grok->predicates[i] = *gct;
+  }
+}
+
 const char *grok_version() {
   return GROK_VERSION;
 }
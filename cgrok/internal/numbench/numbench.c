@@ -0,0 +1,20 @@
+#include "numbench.h"
+#include "grok_number.c"
+
+double parse_number_fields(const char *buf, int len, int mode) {
+  double sum = 0;
+  const char *end = buf + len;
+  while (buf < end) {
+    int n = strlen(buf);
+    long l;
+    double d;
+    switch (mode) {
+      case 0: grok_parse_long(buf, n, 10, &l); sum += l; break;
+      case 1: sum += strtol(buf, NULL, 10); break;
+      case 2: grok_parse_double(buf, n, &d); sum += d; break;
+      case 3: sum += strtod(buf, NULL); break;
+    }
+    buf += n + 1;
+  }
+  return sum;
+}
@@ -0,0 +1,37 @@
+/* Package numbench compares grok's number parsers with strtol and strtod.
+   It only exists for its benchmarks, so that the comparison code stays out
+   of the grok package itself. */
+package numbench
+
+/*
+#cgo CFLAGS: -I../.. -std=gnu99
+#include <stdlib.h>
+#include "numbench.h"
+*/
+import "C"
+
+import (
+	"strings"
+	"unsafe"
+)
+
+const (
+	parseLong = iota
+	strtol
+	parseDouble
+	strtod
+)
+
+/* Parse fields n times over with one of the parse_number_fields modes */
+func parseNumberFields(fields []string, mode int, n int) float64 {
+	joined := strings.Join(fields, "\x00") + "\x00"
+	buf := C.CString(joined)
+	defer C.free(unsafe.Pointer(buf))
+	length := C.int(len(joined))
+
+	sum := 0.0
+	for i := 0; i < n; i++ {
+		sum += float64(C.parse_number_fields(buf, length, C.int(mode)))
+	}
+	return sum
+}
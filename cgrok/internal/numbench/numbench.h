@@ -0,0 +1,20 @@
+/*
+ * A private copy of grok's number parsers, renamed so that they don't clash
+ * with the grok package's own when both are linked into one test binary.
+ */
+#ifndef _NUMBENCH_H_
+#define _NUMBENCH_H_
+
+#define grok_parse_long numbench_parse_long
+#define grok_parse_double numbench_parse_double
+#define grok_parse_ipv4 numbench_parse_ipv4
+#include "grok_number.h"
+
+/**
+ * Parse each of the NUL separated fields in buf and add them up.
+ *
+ * @param mode 0 grok_parse_long, 1 strtol, 2 grok_parse_double, 3 strtod.
+ */
+double parse_number_fields(const char *buf, int len, int mode);
+
+#endif /* _NUMBENCH_H_ */
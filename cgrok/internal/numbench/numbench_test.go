@@ -0,0 +1,23 @@
+package numbench
+
+import "testing"
+
+/* Status codes, byte counts and durations, as they turn up in access logs */
+var numberFields = []string{"200", "1532", "0.043", "404", "-12.5", "48213",
+	"1e3", "0.000125", "302", "1428722860.123"}
+
+func BenchmarkParseNumbers(b *testing.B) {
+	parseNumberFields(numberFields, parseLong, b.N)
+}
+
+func BenchmarkParseNumbersStrtol(b *testing.B) {
+	parseNumberFields(numberFields, strtol, b.N)
+}
+
+func BenchmarkParseFloats(b *testing.B) {
+	parseNumberFields(numberFields, parseDouble, b.N)
+}
+
+func BenchmarkParseFloatsStrtod(b *testing.B) {
+	parseNumberFields(numberFields, strtod, b.N)
+}
@@ -1,12 +1,18 @@
 
+#include <ctype.h>
+#include <errno.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <string.h>
 
 #include "stringhelper.h"
+#include "grok_cidr.h"
 #include "grok_logging.h"
+#include "grok_number.h"
 #include "predicates.h"
 
 static pcre *regexp_predicate_op = NULL;
+static pthread_once_t regexp_predicate_once = PTHREAD_ONCE_INIT;
 #define REGEXP_PREDICATE_RE \
   "(?:\\s*([!=])~" \
   "\\s*" \
@@ -38,13 +44,19 @@ int strop(const char * const args, int args_len);
     } 
 
 
+/* Regexp predicates are shared by every capture using the same expanded
+ * regexp and sense, and live until the process exits. */
 typedef struct grok_predicate_regexp {
-  //pcre *re;
-  grok_t gre;
+  pcre *re;
+  pcre_extra *re_extra;
   char *pattern;
   int negative_match;
 } grok_predicate_regexp_t;
 
+/* "=regexp" or "!regexp" -> grok_predicate_regexp_t * */
+static TCTREE *regexp_predicate_cache = NULL;
+static pthread_mutex_t regexp_predicate_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
 typedef struct grok_predicate_numcompare {
   enum { DOUBLE, LONG } type;
   operation op;
@@ -60,23 +72,44 @@ typedef struct grok_predicate_strcompare {
   int len;
 } grok_predicate_strcompare_t;
 
+/* A set of strings in an open-addressed hash table, built once when the
+ * predicate is compiled. Slots hold index + 1 into offsets/lengths, or 0. */
+typedef struct grok_predicate_in {
+  int negative_match;
+  char *strings;
+  int *offsets;
+  int *lengths;
+  int nstrings;
+  uint32_t *hashes;
+  uint32_t *slots;
+  uint32_t mask;
+} grok_predicate_in_t;
+
+typedef struct grok_predicate_cidr {
+  int negative_match;
+  grok_cidr_tree_t tree;
+} grok_predicate_cidr_t;
+
 int grok_predicate_regexp(grok_t *grok, const grok_capture *gct,
                           const char *subject, int start, int end);
 int grok_predicate_numcompare(grok_t *grok, const grok_capture *gct,
                               const char *subject, int start, int end);
 int grok_predicate_strcompare(grok_t *grok, const grok_capture *gct,
                               const char *subject, int start, int end);
+int grok_predicate_in(grok_t *grok, const grok_capture *gct,
+                      const char *subject, int start, int end);
+int grok_predicate_cidr(grok_t *grok, const grok_capture *gct,
+                        const char *subject, int start, int end);
 
+/* Run once, with pthread_once(), since groks may compile concurrently */
 static void grok_predicate_regexp_global_init(void) {
+  int erroffset = -1;
+  const char *errp;
+  regexp_predicate_op = pcre_compile(REGEXP_PREDICATE_RE, 0,
+                                     &errp, &erroffset, NULL);
   if (regexp_predicate_op == NULL) {
-    int erroffset = -1;
-    const char *errp;
-    regexp_predicate_op = pcre_compile(REGEXP_PREDICATE_RE, 0, 
-                                       &errp, &erroffset, NULL);
-    if (regexp_predicate_op == NULL) {
-      fprintf(stderr, "Internal error (compiling predicate regexp op): %s\n",
-              errp);
-    }
+    fprintf(stderr, "Internal error (compiling predicate regexp op): %s\n",
+            errp);
   }
 }
 
@@ -88,7 +121,7 @@ int grok_predicate_regexp_init(grok_t *grok, grok_capture *gct,
 
   grok_log(grok, LOG_PREDICATE, "Regexp predicate found: '%.*s'", args_len, args);
 
-  grok_predicate_regexp_global_init();
+  pthread_once(&regexp_predicate_once, grok_predicate_regexp_global_init);
   ret = pcre_exec(regexp_predicate_op, NULL, args, args_len, 0, 0,
                   capture_vector, REGEXP_OVEC_SIZE * 3);
   if (ret < 0) {
@@ -99,56 +132,96 @@ int grok_predicate_regexp_init(grok_t *grok, grok_capture *gct,
   }
 
   int start, end;
+  int negative_match;
+  char *expanded;
+  int expanded_len;
   grok_predicate_regexp_t *gprt;
+  const void *cached;
+  int cached_len;
   start = capture_vector[6]; /* capture #3 */
   end = capture_vector[7];
-
-  gprt = calloc(1, sizeof(grok_predicate_regexp_t));
-  gprt->pattern = calloc(1, end - start + 1);
-  strncpy(gprt->pattern, args + start, end - start);
-  //gprt->re = pcre_compile(gprt->pattern, 0, &errptr, &erroffset, NULL);
-
-  grok_log(grok, LOG_PREDICATE, "Regexp predicate is '%s'", gprt->pattern);
-  grok_clone(&gprt->gre, grok);
-  ret = grok_compile(&gprt->gre, gprt->pattern, renamed_only);
-
-  gprt->negative_match = (args[capture_vector[2]] == '!');
-
-  if (ret != 0) {
-    fprintf(stderr, "An error occurred while compiling the predicate for %s:\n",
+  negative_match = (args[capture_vector[2]] == '!');
+
+  /* Key the cache on the expanded regexp, so the same %{FOO} in patterns
+   * from different libraries doesn't get confused. The first byte is the
+   * sense of the match. */
+  expanded = grok_expand_match_only(grok, args + start, end - start,
+                                    &expanded_len);
+  if (expanded == NULL) {
+    fprintf(stderr, "An error occurred while expanding the predicate for %s\n",
             gct->name);
-    fprintf(stderr, "Error at pos %d: %s\n",
-            grok->pcre_erroffset, grok->pcre_errptr);
     return 1;
   }
+  expanded = realloc(expanded, expanded_len + 2);
+  memmove(expanded + 1, expanded, expanded_len + 1);
+  expanded[0] = negative_match ? '!' : '=';
+
+  pthread_mutex_lock(&regexp_predicate_cache_lock);
+  if (regexp_predicate_cache == NULL) {
+    regexp_predicate_cache = tctreenew();
+  }
+  cached = tctreeget(regexp_predicate_cache, expanded, expanded_len + 1,
+                     &cached_len);
+  if (cached != NULL) {
+    gprt = *(grok_predicate_regexp_t **)cached;
+  } else {
+    const char *errptr;
+    int erroffset;
+    pcre *re = pcre_compile(expanded + 1, 0, &errptr, &erroffset, NULL);
+    if (re == NULL) {
+      pthread_mutex_unlock(&regexp_predicate_cache_lock);
+      fprintf(stderr, "An error occurred while compiling the predicate for %s:\n",
+              gct->name);
+      fprintf(stderr, "Error at pos %d: %s\n", erroffset, errptr);
+      free(expanded);
+      return 1;
+    }
+    gprt = calloc(1, sizeof(grok_predicate_regexp_t));
+    gprt->re = re;
+    gprt->re_extra = pcre_study(re, 0, &errptr);
+    gprt->pattern = string_ndup(args + start, end - start);
+    gprt->negative_match = negative_match;
+    tctreeput(regexp_predicate_cache, expanded, expanded_len + 1,
+              &gprt, sizeof(gprt));
+    grok_log(grok, LOG_PREDICATE, "Compiled %sregex for '%s': '%s'",
+             (gprt->negative_match) ? "negative match " : "",
+             gct->name, expanded + 1);
+  }
+  pthread_mutex_unlock(&regexp_predicate_cache_lock);
+  free(expanded);
 
-  grok_log(grok, LOG_PREDICATE, 
-           "Compiled %sregex for '%s': '%s'", 
-           (gprt->negative_match) ? "negative match " : "",
-           gct->name, gprt->pattern);
-  /* strdup here and be lazy. Otherwise, we'll have to add a new member
-   * to grok_capture which indicates which fields of it are set to 
-   * non-heap pointers. */
-
-  /* Break const... */
-  size_t constlen = strlen("grok_predicate_regexp");
-  gct->predicate_func_name = string_ndup("grok_predicate_regexp", constlen);
-  gct->predicate_func_name_len = constlen;
+  grok_log(grok, LOG_PREDICATE, "Regexp predicate is '%s'", gprt->pattern);
+
+  gct->predicate_func = grok_predicate_regexp;
   grok_capture_set_extra(grok, gct, gprt);
   grok_capture_add(grok, gct, renamed_only);
 
   return 0;
 }
 
+int grok_predicate_regexp_cache_size(void) {
+  int size = 0;
+  pthread_mutex_lock(&regexp_predicate_cache_lock);
+  if (regexp_predicate_cache != NULL) {
+    size = (int)dict_count(regexp_predicate_cache->dict);
+  }
+  pthread_mutex_unlock(&regexp_predicate_cache_lock);
+  return size;
+}
+
 int grok_predicate_regexp(grok_t *grok, const grok_capture *gct,
                           const char *subject, int start, int end) {
   grok_predicate_regexp_t *gprt; /* XXX: grok_capture extra */
   int ret;
 
   gprt = *(grok_predicate_regexp_t **)(gct->extra.extra_val);
-  ret = grok_execn(&gprt->gre, subject + start, end - start, NULL);
-  
-  grok_log(grok, LOG_PREDICATE, "RegexCompare: grok_execn returned %d", ret);
+
+  /* Match only: no capture vector, so nothing to allocate */
+  ret = pcre_exec(gprt->re, gprt->re_extra, subject + start, end - start,
+                  0, 0, NULL, 0);
+  ret = (ret >= 0) ? GROK_OK : GROK_ERROR_NOMATCH;
+
+  grok_log(grok, LOG_PREDICATE, "RegexCompare: pcre_exec returned %d", ret);
 
   /* negate the match if necessary */
   if (gprt->negative_match) {
@@ -164,7 +237,7 @@ int grok_predicate_regexp(grok_t *grok, const grok_capture *gct,
            (end - start), subject + start, gprt->pattern,
            (ret < 0) ? "false" : "true");
 
-  /* grok_execn returns GROK_OK for success. */
+  /* ret is GROK_OK for success. */
   /* pcre_callout expects:
    * 0 == ok, 
    * >=1 for 'fail but try another match'
@@ -181,13 +254,7 @@ int grok_predicate_regexp(grok_t *grok, const grok_capture *gct,
 int grok_predicate_numcompare_init(grok_t *grok, grok_capture *gct,
                                    const char *args, int args_len, int renamed_only) {
   grok_predicate_numcompare_t *gpnt;
-
-  /* I know I said that args is a const char, but we need to modify the string
-   * temporarily so that strtol and strtod don't overflow a buffer when they
-   * don't see a terminator. */
-  char *tmp = (char *)args;
   int pos;
-  char a = args[args_len];
 
   grok_log(grok, LOG_PREDICATE, "Number compare predicate found: '%.*s'",
            args_len, args);
@@ -197,26 +264,20 @@ int grok_predicate_numcompare_init(grok_t *grok, grok_capture *gct,
   gpnt->op = strop(args, args_len);
   pos = OP_LEN(gpnt->op);
 
-  tmp[args_len] = 0; /* force null byte so strtol doesn't run wild */
-
   /* Optimize and use long type if the number is not a float (no period) */
-  if (strchr(tmp, '.') == NULL) {
+  if (memchr(args, '.', args_len) == NULL) {
     gpnt->type = LONG;
-    gpnt->u.lvalue = strtol(tmp + pos, NULL, 0);
+    grok_parse_long(args + pos, args_len - pos, 0, &gpnt->u.lvalue);
     grok_log(grok, LOG_PREDICATE, "Arg '%.*s' is non-floating, assuming long type",
-             args_len - pos, tmp + pos);
+             args_len - pos, args + pos);
   } else {
     gpnt->type = DOUBLE;
-    gpnt->u.dvalue = strtod(tmp + pos, NULL);
+    grok_parse_double(args + pos, args_len - pos, &gpnt->u.dvalue);
     grok_log(grok, LOG_PREDICATE, "Arg '%.*s' looks like a double, assuming double",
-             args_len - pos, tmp + pos);
+             args_len - pos, args + pos);
   }
-  /* Restore the original character at the end, which probably wasn't a null byte */
-  tmp[args_len] = a;
 
-  size_t constlen = strlen("grok_predicate_numcompare");
-  gct->predicate_func_name = string_ndup("grok_predicate_numcompare", constlen);
-  gct->predicate_func_name_len = constlen;
+  gct->predicate_func = grok_predicate_numcompare;
   grok_capture_set_extra(grok, gct, gpnt);
   grok_capture_add(grok, gct, renamed_only);
   return 0;
@@ -229,16 +290,17 @@ int grok_predicate_numcompare(grok_t *grok, const grok_capture *gct,
 
   gpnt = *(grok_predicate_numcompare_t **)(gct->extra.extra_val);
 
+  /* Compare rather than subtract, which could overflow */
   if (gpnt->type == DOUBLE) {
-    double a = strtod(subject + start, NULL);
-    double b = gpnt->u.dvalue;
-    OP_RUN(gpnt->op, a - b, ret);
+    double a, b = gpnt->u.dvalue;
+    grok_parse_double(subject + start, end - start, &a);
+    OP_RUN(gpnt->op, (a > b) - (a < b), ret);
     grok_log(grok, LOG_PREDICATE, "NumCompare(double): %f vs %f == %s (%d)",
              a, b, (ret) ? "false" : "true", ret);
   } else {
-    long a = strtol(subject + start, NULL, 0);
-    long b = gpnt->u.lvalue;
-    OP_RUN(gpnt->op, a - b, ret);
+    long a, b = gpnt->u.lvalue;
+    grok_parse_long(subject + start, end - start, 0, &a);
+    OP_RUN(gpnt->op, (a > b) - (a < b), ret);
     grok_log(grok, LOG_PREDICATE, "NumCompare(long): %ld vs %ld == %s (%d)",
              a, b, (ret) ? "false" : "true", ret);
   }
@@ -272,9 +334,7 @@ int grok_predicate_strcompare_init(grok_t *grok, grok_capture *gct,
   gpst->value = malloc(gpst->len);
   memcpy(gpst->value, args + pos, gpst->len);
 
-  size_t constlen = strlen("grok_predicate_strcompare");
-  gct->predicate_func_name = string_ndup("grok_predicate_strcompare", constlen);
-  gct->predicate_func_name_len = constlen;
+  gct->predicate_func = grok_predicate_strcompare;
   grok_capture_set_extra(grok, gct, gpst);
   grok_capture_add(grok, gct, renamed_only);
 
@@ -301,6 +361,267 @@ int grok_predicate_strcompare(grok_t *grok, const grok_capture *gct,
   return ret;
 }
 
+/* Read a whole file into a NUL-terminated buffer, for predicates taking
+ * file:/path arguments. Returns NULL, with a message, on failure. */
+static char *predicate_read_file(grok_t *grok, const char *path, int path_len,
+                                 int *len) {
+  char *filename = string_ndup(path, path_len);
+  char *buffer = NULL;
+  FILE *fp;
+  long size;
+
+  fp = fopen(filename, "r");
+  if (fp == NULL) {
+    fprintf(stderr, "Unable to open '%s' for reading: %s\n", filename,
+            strerror(errno));
+    free(filename);
+    return NULL;
+  }
+
+  fseek(fp, 0, SEEK_END);
+  size = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+  if (size >= 0) {
+    buffer = malloc(size + 1);
+    *len = fread(buffer, 1, size, fp);
+    buffer[*len] = '\0';
+  }
+  grok_log(grok, LOG_PREDICATE, "Read %d bytes from '%s'", *len, filename);
+
+  fclose(fp);
+  free(filename);
+  return buffer;
+}
+
+static uint32_t in_hash(const char *str, int len) {
+  uint32_t hash = 2166136261u; /* FNV-1a */
+  int i;
+  for (i = 0; i < len; i++) {
+    hash = (hash ^ (unsigned char)str[i]) * 16777619u;
+  }
+  return hash;
+}
+
+/* Returns the slot holding str, or the empty slot where it would go */
+static uint32_t in_lookup(const grok_predicate_in_t *gpit, const char *str,
+                          int len, uint32_t hash) {
+  uint32_t slot = hash & gpit->mask;
+  for (;;) {
+    uint32_t entry = gpit->slots[slot];
+    if (entry == 0) {
+      return slot;
+    }
+    entry--;
+    if (gpit->hashes[entry] == hash && gpit->lengths[entry] == len
+        && !memcmp(gpit->strings + gpit->offsets[entry], str, len)) {
+      return slot;
+    }
+    slot = (slot + 1) & gpit->mask;
+  }
+}
+
+/* Split members on sep, trim whitespace, and push the nonempty ones */
+static void predicate_split(const char *str, int len, char sep,
+                            TCLIST *members) {
+  const char *end = str + len;
+  while (str < end) {
+    const char *next = memchr(str, sep, end - str);
+    const char *stop = (next == NULL) ? end : next;
+    while (str < stop && isspace(*str)) {
+      str++;
+    }
+    while (stop > str && isspace(stop[-1])) {
+      stop--;
+    }
+    if (stop > str && !(sep == '\n' && *str == '#')) {
+      tclistpush(members, str, stop - str);
+    }
+    str = (next == NULL) ? end : next + 1;
+  }
+}
+
+/* Parse the arguments of a predicate taking a list, "op {a,b,...}" or
+ * "op file:/path" with one member per line. Sets *negative_match if op was
+ * prefixed with '!'. Returns NULL, with a message, on failure. */
+static TCLIST *predicate_members(grok_t *grok, const char *args, int args_len,
+                                 int op_len, int *negative_match) {
+  TCLIST *members;
+
+  *negative_match = 0;
+  if (args[0] == '!') {
+    *negative_match = 1;
+    args++;
+    args_len--;
+  }
+  args += op_len;
+  args_len -= op_len;
+  while (args_len > 0 && isspace(*args)) {
+    args++;
+    args_len--;
+  }
+  while (args_len > 0 && isspace(args[args_len - 1])) {
+    args_len--;
+  }
+
+  members = tclistnew();
+  if (args_len >= 2 && args[0] == '{' && args[args_len - 1] == '}') {
+    predicate_split(args + 1, args_len - 2, ',', members);
+  } else if (args_len > 5 && !strncmp(args, "file:", 5)) {
+    int len = 0;
+    char *buffer = predicate_read_file(grok, args + 5, args_len - 5, &len);
+    if (buffer == NULL) {
+      tclistdel(members);
+      return NULL;
+    }
+    predicate_split(buffer, len, '\n', members);
+    free(buffer);
+  } else {
+    fprintf(stderr, "Invalid predicate arguments: '%.*s', expected "
+            "{a,b,...} or file:/path\n", args_len, args);
+    tclistdel(members);
+    return NULL;
+  }
+  return members;
+}
+
+int grok_predicate_in_init(grok_t *grok, grok_capture *gct,
+                           const char *args, int args_len, int renamed_only) {
+  grok_predicate_in_t *gpit;
+  TCLIST *members;
+  int negative_match;
+  int size = 0;
+  int i, offset = 0;
+  uint32_t nslots;
+
+  grok_log(grok, LOG_PREDICATE, "Set membership predicate found: '%.*s'",
+           args_len, args);
+
+  members = predicate_members(grok, args, args_len, 3, &negative_match);
+  if (members == NULL) {
+    return 1;
+  }
+
+  gpit = calloc(1, sizeof(grok_predicate_in_t));
+  gpit->negative_match = negative_match;
+  gpit->nstrings = tclistnum(members);
+  for (i = 0; i < gpit->nstrings; i++) {
+    tclistval(members, i, &size);
+    offset += size;
+  }
+
+  /* At most half full, so probe sequences stay short */
+  nslots = 2;
+  while (nslots < 2 * (uint32_t)gpit->nstrings) {
+    nslots <<= 1;
+  }
+  gpit->mask = nslots - 1;
+  gpit->slots = calloc(nslots, sizeof(uint32_t));
+  gpit->strings = malloc(offset + 1);
+  gpit->offsets = malloc(gpit->nstrings * sizeof(int));
+  gpit->lengths = malloc(gpit->nstrings * sizeof(int));
+  gpit->hashes = malloc(gpit->nstrings * sizeof(uint32_t));
+
+  offset = 0;
+  for (i = 0; i < gpit->nstrings; i++) {
+    const char *member = tclistval(members, i, &size);
+    uint32_t hash = in_hash(member, size);
+    uint32_t slot = in_lookup(gpit, member, size, hash);
+    if (gpit->slots[slot] != 0) {
+      continue; /* duplicate */
+    }
+    memcpy(gpit->strings + offset, member, size);
+    gpit->offsets[i] = offset;
+    gpit->lengths[i] = size;
+    gpit->hashes[i] = hash;
+    gpit->slots[slot] = i + 1;
+    offset += size;
+  }
+  tclistdel(members);
+
+  grok_log(grok, LOG_PREDICATE, "Set of %d strings in %u slots",
+           gpit->nstrings, nslots);
+
+  gct->predicate_func = grok_predicate_in;
+  grok_capture_set_extra(grok, gct, gpit);
+  grok_capture_add(grok, gct, renamed_only);
+  return 0;
+}
+
+int grok_predicate_in(grok_t *grok, const grok_capture *gct,
+                      const char *subject, int start, int end) {
+  grok_predicate_in_t *gpit;
+  const char *str = subject + start;
+  int len = end - start;
+  int found;
+
+  gpit = *(grok_predicate_in_t **)(gct->extra.extra_val);
+  found = gpit->slots[in_lookup(gpit, str, len, in_hash(str, len))] != 0;
+
+  grok_log(grok, LOG_PREDICATE, "In: '%.*s' %s in the set",
+           len, str, found ? "is" : "is not");
+
+  return found == gpit->negative_match;
+}
+
+int grok_predicate_cidr_init(grok_t *grok, grok_capture *gct,
+                             const char *args, int args_len, int renamed_only) {
+  grok_predicate_cidr_t *gpct;
+  TCLIST *members;
+  int negative_match;
+  int i;
+
+  grok_log(grok, LOG_PREDICATE, "CIDR predicate found: '%.*s'",
+           args_len, args);
+
+  members = predicate_members(grok, args, args_len, 5, &negative_match);
+  if (members == NULL) {
+    return 1;
+  }
+
+  gpct = calloc(1, sizeof(grok_predicate_cidr_t));
+  gpct->negative_match = negative_match;
+  grok_cidr_tree_init(&gpct->tree);
+  for (i = 0; i < tclistnum(members); i++) {
+    int size;
+    const char *range = tclistval(members, i, &size);
+    if (grok_cidr_tree_add_text(&gpct->tree, range, size) != 0) {
+      /* Skipping it would let its addresses past a !@cidr deny list */
+      fprintf(stderr, "Invalid CIDR range: '%.*s'\n", size, range);
+      grok_cidr_tree_clean(&gpct->tree);
+      free(gpct);
+      tclistdel(members);
+      return 1;
+    }
+  }
+  tclistdel(members);
+
+  grok_log(grok, LOG_PREDICATE, "CIDR tree has %d nodes", gpct->tree.nnodes);
+
+  gct->predicate_func = grok_predicate_cidr;
+  grok_capture_set_extra(grok, gct, gpct);
+  grok_capture_add(grok, gct, renamed_only);
+  return 0;
+}
+
+int grok_predicate_cidr(grok_t *grok, const grok_capture *gct,
+                        const char *subject, int start, int end) {
+  grok_predicate_cidr_t *gpct;
+  uint32_t addr;
+  int found = 0;
+
+  gpct = *(grok_predicate_cidr_t **)(gct->extra.extra_val);
+
+  /* Anything that isn't an IPv4 address, like an IPv6 one, is in no range */
+  if (grok_parse_ipv4(subject + start, end - start, &addr) == end - start) {
+    found = grok_cidr_tree_contains(&gpct->tree, addr);
+  }
+
+  grok_log(grok, LOG_PREDICATE, "CIDR: '%.*s' %s in a range",
+           end - start, subject + start, found ? "is" : "is not");
+
+  return found == gpct->negative_match;
+}
+
 int strop(const char * const args, int args_len) {
   if (args_len == 0)
     return -1;
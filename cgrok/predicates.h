@@ -10,10 +10,28 @@
 
 int grok_predicate_regexp_init(grok_t *grok, grok_capture *gct,
                                const char *args, int args_len, int renamed_only);
+
+/* Number of distinct compiled regexps shared by regexp predicates, counting
+ * =~ and !~ of the same regexp separately */
+int grok_predicate_regexp_cache_size(void);
 int grok_predicate_numcompare_init(grok_t *grok, grok_capture *gct,
                                    const char *args, int args_len, int renamed_only);
 int grok_predicate_strcompare_init(grok_t *grok, grok_capture *gct,
                                    const char *args, int args_len, int renamed_only);
 
+/* Set membership predicate
+ * Activate with '@in {a,b,c}' or '@in file:/path', one member per line;
+ * '!@in' negates it
+ */
+int grok_predicate_in_init(grok_t *grok, grok_capture *gct,
+                           const char *args, int args_len, int renamed_only);
+
+/* IPv4 range predicate
+ * Activate with '@cidr {10.0.0.0/8,192.0.2.1}' or '@cidr file:/path', one
+ * range per line; '!@cidr' negates it
+ */
+int grok_predicate_cidr_init(grok_t *grok, grok_capture *gct,
+                             const char *args, int args_len, int renamed_only);
+
 
 #endif /* _PREDICATES_H_ */